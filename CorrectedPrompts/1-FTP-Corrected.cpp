@@ -8,60 +8,701 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <deque>
+#include <list>
+#include <unordered_set>
+#include <set>
 #include <algorithm>
 #include <limits>
-#include <openssl/sha.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <condition_variable>
+#include <zlib.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
 
 using namespace std;
 
 // Configuration
 const int FTP_PORT = 2121;
 const string PUBLIC_FOLDER = "./public";
-const int MAX_CLIENTS = 10;
+const int MAX_CLIENTS = 10;                // Concurrent control sessions per client IP; loopback is exempt
 const size_t MAX_COMMAND_LENGTH = 512;
+const size_t COMMAND_BUFFER_SIZE = 4096;  // Per-session ring buffer, must be a power of two
+const int MAX_REPLY_IOVECS = 64;          // Replies coalesced into one writev()
 const size_t MAX_FILE_SIZE = 100 * 1024 * 1024; // 100MB
 const unsigned int SESSION_TIMEOUT = 300; // 5 minutes in seconds
+const int TIMER_WHEEL_BITS = 6;            // 64 slots per wheel level
+const int TIMER_WHEEL_LEVELS = 4;          // One-second ticks, deadlines up to ~194 days ahead
+const int LISTEN_BACKLOG = SOMAXCONN;
+const int MAX_EPOLL_EVENTS = 256;
+const size_t TRANSFER_CHUNK_SIZE = 256 * 1024;
+const bool ZERO_COPY_TRANSFERS = true;          // false restores the read()/send() copy path
+const off_t MMAP_TRANSFER_THRESHOLD = 256 * 1024; // Files up to this size are served from mmap
+const int INDEX_COALESCE_MS = 20;          // Batch inotify events arriving within this window
+const string LOG_FILE = "./ftp_server.log";
+const size_t LOG_RING_CAPACITY = 1024;     // Records buffered per thread, must be a power of two
+const bool LOG_BLOCK_WHEN_FULL = false;    // false drops records instead of stalling the caller
+const int LOG_FLUSH_INTERVAL_MS = 10;
+const int PASV_PORT_MIN = 50000;           // One listener per port is bound at startup
+const int PASV_PORT_MAX = 50999;
+const unsigned int DATA_WORKER_THREADS = 4;
+const unsigned int DATA_CONNECT_TIMEOUT = 30; // Seconds a client has to open the data connection
+const int MAX_TRANSFERS_PER_SESSION = 8;   // Parallel ranged RETRs one control session may run
+const size_t FILE_CACHE_BUDGET = 256 * 1024 * 1024; // Bytes of hot file contents kept mapped
+const off_t FILE_CACHE_MAX_FILE = 16 * 1024 * 1024;  // Larger files always stream from disk
+const size_t FILE_CACHE_SHARDS = 16;
+const string METRICS_SOCKET = "./ftp_metrics.sock"; // Local text endpoint, readable by the owner only
+const int HISTOGRAM_SUB_BUCKET_BITS = 4;   // 16 linear buckets per power of two, ~6% resolution
+const int HISTOGRAM_MAX_MAGNITUDE = 40;    // Latencies beyond 2^40 ns share the last bucket
+const string IO_ENGINE = "auto";           // "auto", "io_uring" or "epoll"; FTP_IO_ENGINE overrides it
+const unsigned int URING_ENTRIES = 256;
+const unsigned int URING_RECV_BUFFERS = 256;  // Provided control buffers per event loop, a power of two
+const size_t URING_RECV_BUFFER_SIZE = 2048;
+const size_t URING_SEGMENT_SIZE = 128 * 1024; // One linked read+send pair
+const int URING_CHAIN_SEGMENTS = 4;           // Pairs submitted together per RETR chain
+const size_t ADMISSION_TABLE_SIZE = 4096;     // Distinct connected addresses tracked, a power of two
+const int64_t GLOBAL_RATE_LIMIT = 0;          // RETR bytes per second for the whole server, 0 = unlimited
+const int64_t PER_IP_RATE_LIMIT = 0;          // RETR bytes per second per client address, 0 = unlimited
+const int64_t PER_USER_RATE_LIMIT = 0;        // RETR bytes per second per login, 0 = unlimited
+const int64_t SHAPING_BURST = 256 * 1024;     // Bytes a quiet bucket may send at once
+const int64_t SHAPING_QUANTUM = 64 * 1024;    // Bytes requested from the buckets per grant
+const string CREDENTIALS_FILE = "./ftp_users.conf";
+const uint64_t SCRYPT_N = 1 << 14;            // scrypt cost for new entries: 16 MiB and ~50 ms per check
+const uint32_t SCRYPT_R = 8;
+const uint32_t SCRYPT_P = 1;
+const uint64_t SCRYPT_MAX_MEMORY = 64 * 1024 * 1024;
+const size_t SCRYPT_SALT_LENGTH = 16;
+const size_t SCRYPT_KEY_LENGTH = 32;
+const unsigned int AUTH_WORKER_THREADS = 2;
+const size_t AUTH_QUEUE_LIMIT = 256;          // Pending logins beyond this are refused with 421
+const string ZCACHE_FOLDER = "./ftp_zcache";  // MODE Z sidecars, outside the public folder
+const off_t ZCACHE_MIN_FILE = 4 * 1024;       // Smaller files are always compressed on the fly
+const int ZCACHE_LEVEL = 9;                   // Sidecars are built once, so spend the CPU
+const int ZLIB_STREAM_LEVEL = 6;              // On-the-fly MODE Z compression
+const string SERVER_CONFIG_FILE = "./ftp_server.conf"; // Optional limit overrides, re-read on SIGHUP
+const string HANDOVER_SOCKET = "./ftp_handover.sock";  // A process started with --takeover connects here
+const int HANDOVER_TIMEOUT_MS = 30000;        // The old process keeps serving if the new one is not up by then
+const size_t HANDOVER_BATCH = 200;            // Descriptors per SCM_RIGHTS message (the kernel allows 253)
+const size_t HANDOVER_RECORD_SIZE = 64 * 1024;
+const unsigned int DRAIN_TIMEOUT = 600;       // Seconds a replaced process waits for in-flight transfers
 
 // Security constants
-const vector<string> ALLOWED_COMMANDS = {"USER", "PASS", "QUIT", "LIST", "RETR", "SIZE"};
+const vector<string> ALLOWED_COMMANDS = {"USER", "PASS", "QUIT", "LIST", "RETR", "SIZE",
+                                         "NLST", "PASV", "EPSV", "TYPE", "NOOP", "STAT",
+                                         "REST", "RANG", "FEAT", "MODE"};
 const string ALLOWED_CHARS = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.";
 
-mutex logMutex;
+enum class TransferMethod { Copy, Sendfile, Mmap, Memory, Uring, Deflate };
+
+// Data-channel payload: a file streamed as the socket becomes writable, or an in-memory buffer
+struct FileTransfer {
+    int fd = -1;
+    off_t start = 0;
+    off_t offset = 0;
+    off_t end = 0;                    // Exclusive end of the byte range
+    TransferMethod method = TransferMethod::Copy;
+    const char* memory = nullptr;     // Mapped file or payload bytes
+    size_t mappedLength = 0;          // Set by startFileTransfer(), mapped by mapFileTransfer()
+    shared_ptr<const void> owner;     // When set, fd and memory belong to it (cache entry or LIST payload)
+    chrono::steady_clock::time_point started;
+    shared_ptr<z_stream> deflater;    // MODE Z on the fly: [offset, end) is compressed as it is sent
+    string compressed;                // Deflate output not yet sent
+    size_t compressedSent = 0;
+    bool deflateDone = false;
+};
+
+// Ring buffer that splits the control stream into CRLF-terminated commands
+class LineFramer {
+public:
+    enum class Result { None, Line, TooLong };
+    
+    // Contiguous free space for the next recv()
+    char* writePointer() { return data + (tail & (COMMAND_BUFFER_SIZE - 1)); }
+    size_t writableBytes() const {
+        size_t free = COMMAND_BUFFER_SIZE - (tail - head);
+        return min(free, COMMAND_BUFFER_SIZE - (tail & (COMMAND_BUFFER_SIZE - 1)));
+    }
+    void commit(size_t bytes) { tail += bytes; }
+    bool empty() const { return head == tail; }
+    
+    // Extract the next complete command; partial lines stay buffered for the next read
+    Result nextLine(string& line) {
+        for (; scanned < tail; ++scanned) {
+            if (data[scanned & (COMMAND_BUFFER_SIZE - 1)] != '\n') continue;
+            
+            size_t end = scanned++;
+            if (discarding) {
+                discarding = false;
+                head = scanned;
+                return Result::TooLong;
+            }
+            if (end > head && data[(end - 1) & (COMMAND_BUFFER_SIZE - 1)] == '\r') --end;
+            line.clear();
+            for (size_t i = head; i < end; ++i) line += data[i & (COMMAND_BUFFER_SIZE - 1)];
+            head = scanned;
+            return Result::Line;
+        }
+        
+        // Drop an oversized line as it arrives and report it once it terminates
+        if (discarding || tail - head > MAX_COMMAND_LENGTH + 1) {
+            discarding = true;
+            head = tail;
+        }
+        return Result::None;
+    }
+    
+private:
+    char data[COMMAND_BUFFER_SIZE];
+    size_t head = 0;    // Monotonic read position
+    size_t tail = 0;    // Monotonic write position
+    size_t scanned = 0; // Bytes already searched for a line terminator
+    bool discarding = false;
+};
+
+// A queued reply: owned text, or a shared immutable payload such as the LIST buffer
+struct ReplyChunk {
+    string text;
+    shared_ptr<const string> shared;
+    
+    const string& bytes() const { return shared ? *shared : text; }
+};
+
+// Seconds from the kernel's tick-granular monotonic clock; a vDSO read with no syscall.
+// Only for deadlines and durations: wall-clock steps must not stall or fire timeouts.
+inline time_t coarseNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return now.tv_sec;
+}
+
+// Intrusive link for anything the timing wheel tracks
+struct TimerNode {
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    time_t deadline = 0;
+    void* owner = nullptr;
+    
+    bool linked() const { return prev != nullptr; }
+};
+
+// Hierarchical timing wheel with one-second ticks: level 0 spans 64 s and every level above spans
+// 64 times the one below. Scheduling and cancelling are O(1); a tick only visits the slot coming due,
+// and higher levels cascade down as the lower ones roll over.
+class TimingWheel {
+public:
+    TimingWheel() {
+        for (auto& level : slots) {
+            for (TimerNode& head : level) head.prev = head.next = &head;
+        }
+        current = coarseNow();
+    }
+    
+    void schedule(TimerNode& node, time_t deadline) {
+        cancel(node);
+        node.deadline = max(deadline, current + 1);
+        place(node);
+    }
+    
+    void cancel(TimerNode& node) {
+        if (!node.linked()) return;
+        node.prev->next = node.next;
+        node.next->prev = node.prev;
+        node.prev = node.next = nullptr;
+    }
+    
+    // Run every timer due up to now; the callback may reschedule the node it is given
+    template <typename Expire>
+    void advance(time_t now, Expire expire) {
+        while (current < now) {
+            ++current;
+            for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+                if ((current >> (TIMER_WHEEL_BITS * (level - 1))) & SLOT_MASK) break;
+                cascade(slots[level][(current >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK]);
+            }
+            
+            TimerNode& head = slots[0][current & SLOT_MASK];
+            while (head.next != &head) {
+                TimerNode* node = head.next;
+                cancel(*node);
+                expire(*node);
+            }
+        }
+    }
+
+private:
+    static const time_t SLOT_MASK = (1 << TIMER_WHEEL_BITS) - 1;
+    TimerNode slots[TIMER_WHEEL_LEVELS][1 << TIMER_WHEEL_BITS];
+    time_t current;
+    
+    void place(TimerNode& node) {
+        time_t delta = node.deadline - current;
+        int level = 0;
+        while (level + 1 < TIMER_WHEEL_LEVELS && delta >= (time_t(1) << (TIMER_WHEEL_BITS * (level + 1)))) ++level;
+        time_t deadline = min(node.deadline, current + (time_t(1) << (TIMER_WHEEL_BITS * (level + 1))) - 1);
+        
+        TimerNode& head = slots[level][(deadline >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK];
+        node.prev = head.prev;
+        node.next = &head;
+        head.prev->next = &node;
+        head.prev = &node;
+    }
+    
+    void cascade(TimerNode& head) {
+        while (head.next != &head) {
+            TimerNode* node = head.next;
+            cancel(*node);
+            place(*node);
+        }
+    }
+};
+
+class EventLoop;
+struct PassiveListener;
+class TokenBucket;
 
 struct ClientSession {
+    uint64_t id;
+    EventLoop* loop;
     int socket;
     string clientIP;
     bool authenticated;
     time_t lastActivity;
     string username;
+    LineFramer input;
+    deque<ReplyChunk> outQueue; // Replies not yet accepted by the kernel
+    size_t outOffset = 0;     // Bytes of outQueue.front() already sent
+    PassiveListener* passive = nullptr; // Listener reserved by the last PASV/EPSV
+    int activeTransfers = 0;
+    off_t restartOffset = 0;            // From REST or RANG, consumed by the next RETR
+    off_t rangeEnd = -1;                // Inclusive RANG end, -1 for end of file
+    bool writePollArmed = false;        // io_uring engine: waiting for the socket to drain
+    TimerNode idleTimer;                // Checked against lastActivity only when it comes due
+    int admissionSlot = -1;             // Per-IP session count charged for this connection
+    TokenBucket* userBucket = nullptr;  // Set at login when per-user shaping is enabled
+    bool authPending = false;           // PASS handed to the auth workers; input is held until it returns
+    bool compressTransfers = false;     // MODE Z: data connections carry a zlib stream
+    bool closing = false;
+};
+
+// One structured log entry; fixed size so producers never allocate
+struct LogRecord {
+    chrono::system_clock::time_point time;
+    long latencyUs; // -1 for entries that are not commands
+    char clientIP[INET_ADDRSTRLEN];
+    char username[64];
+    char command[128];
+    char message[256];
+};
+
+// Single-producer single-consumer ring owned by one logging thread
+struct LogRing {
+    LogRecord slots[LOG_RING_CAPACITY];
+    atomic<size_t> head{0}; // Next slot the writer reads
+    atomic<size_t> tail{0}; // Next slot the producer fills
+};
+
+// Background writer that drains every thread's ring into batched write() calls
+class AsyncLogger {
+public:
+    void start() {
+        fd = open(LOG_FILE.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+        if (fd < 0) {
+            perror("Log file open failed");
+            exit(EXIT_FAILURE);
+        }
+        thread(&AsyncLogger::drain, this).detach();
+    }
+    
+    // Lock-free on the hot path; the registry mutex is only taken on a thread's first record
+    void append(const string& clientIP, const string& username, const string& command,
+                const string& message, long latencyUs) {
+        static thread_local shared_ptr<LogRing> ring = registerRing();
+        
+        size_t tail = ring->tail.load(memory_order_relaxed);
+        while (tail - ring->head.load(memory_order_acquire) >= LOG_RING_CAPACITY) {
+            if (!LOG_BLOCK_WHEN_FULL) {
+                dropped.fetch_add(1, memory_order_relaxed);
+                return;
+            }
+            this_thread::yield();
+        }
+        
+        LogRecord& record = ring->slots[tail & (LOG_RING_CAPACITY - 1)];
+        record.time = chrono::system_clock::now();
+        record.latencyUs = latencyUs;
+        copyField(record.clientIP, sizeof(record.clientIP), clientIP);
+        copyField(record.username, sizeof(record.username), username);
+        copyField(record.command, sizeof(record.command), command);
+        copyField(record.message, sizeof(record.message), message);
+        ring->tail.store(tail + 1, memory_order_release);
+    }
+
+private:
+    int fd = -1;
+    mutex registryMutex;
+    vector<shared_ptr<LogRing>> rings;
+    atomic<unsigned long> dropped{0};
+    
+    static void copyField(char* field, size_t capacity, const string& value) {
+        size_t length = min(value.size(), capacity - 1);
+        memcpy(field, value.data(), length);
+        field[length] = '\0';
+    }
+    
+    shared_ptr<LogRing> registerRing() {
+        auto ring = make_shared<LogRing>();
+        lock_guard<mutex> guard(registryMutex);
+        rings.push_back(ring);
+        return ring;
+    }
+    
+    // Client-supplied text must not break the one-record-per-line format
+    static void appendQuoted(string& out, const char* value) {
+        out += '"';
+        for (const char* c = value; *c; ++c) {
+            out += (isprint(static_cast<unsigned char>(*c)) && *c != '"') ? *c : '?';
+        }
+        out += '"';
+    }
+    
+    static void format(string& out, const LogRecord& record) {
+        time_t seconds = chrono::system_clock::to_time_t(record.time);
+        long micros = chrono::duration_cast<chrono::microseconds>(record.time.time_since_epoch()).count() % 1000000;
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        char stamp[64];
+        snprintf(stamp, sizeof(stamp), "%04d-%02d-%02dT%02d:%02d:%02d.%06ldZ",
+                 utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, micros);
+        
+        out += stamp;
+        if (record.clientIP[0]) out += string(" ip=") + record.clientIP;
+        if (record.username[0]) {
+            out += " user=";
+            appendQuoted(out, record.username);
+        }
+        if (record.command[0]) {
+            out += " cmd=";
+            appendQuoted(out, record.command);
+        }
+        if (record.latencyUs >= 0) out += " latency_us=" + to_string(record.latencyUs);
+        if (record.message[0]) {
+            out += " msg=";
+            appendQuoted(out, record.message);
+        }
+        out += '\n';
+    }
+    
+    void drain() {
+        string batch;
+        while (true) {
+            vector<shared_ptr<LogRing>> snapshot;
+            {
+                lock_guard<mutex> guard(registryMutex);
+                snapshot = rings;
+            }
+            
+            for (auto& ring : snapshot) {
+                size_t head = ring->head.load(memory_order_relaxed);
+                size_t tail = ring->tail.load(memory_order_acquire);
+                for (; head != tail; ++head) {
+                    format(batch, ring->slots[head & (LOG_RING_CAPACITY - 1)]);
+                }
+                ring->head.store(head, memory_order_release);
+            }
+            
+            unsigned long lost = dropped.exchange(0, memory_order_relaxed);
+            if (lost > 0) {
+                LogRecord notice = {chrono::system_clock::now(), -1, "", "", "", ""};
+                copyField(notice.message, sizeof(notice.message), to_string(lost) + " log records dropped");
+                format(batch, notice);
+            }
+            
+            for (size_t written = 0; written < batch.size(); ) {
+                ssize_t n = write(fd, batch.data() + written, batch.size() - written);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                written += n;
+            }
+            
+            if (batch.empty()) this_thread::sleep_for(chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+            batch.clear();
+        }
+    }
 };
 
+AsyncLogger asyncLogger;
+
 // Secure logging function
 void log(const string& message, const ClientSession* session = nullptr) {
-    lock_guard<mutex> guard(logMutex);
-    string logEntry = "[Server] ";
-    if (session) {
-        logEntry += "[" + session->clientIP + "] ";
-        if (!session->username.empty()) {
-            logEntry += "[" + session->username + "] ";
-        }
+    static const string none;
+    asyncLogger.append(session ? session->clientIP : none, session ? session->username : none, none, message, -1);
+}
+
+// Log on behalf of a session owned by another thread
+void log(const string& message, const string& clientIP, const string& username) {
+    asyncLogger.append(clientIP, username, string(), message, -1);
+}
+
+// Record a handled command with its latency; passwords never reach the log
+void logCommand(const ClientSession& session, const string& command, long latencyUs) {
+    bool isPass = command.size() >= 4 && strncasecmp(command.c_str(), "PASS", 4) == 0;
+    asyncLogger.append(session.clientIP, session.username, isPass ? "PASS ****" : command, string(), latencyUs);
+}
+
+const size_t HISTOGRAM_BUCKETS = (HISTOGRAM_MAX_MAGNITUDE - HISTOGRAM_SUB_BUCKET_BITS + 2) << HISTOGRAM_SUB_BUCKET_BITS;
+
+// Log-linear latency histogram in the style of HdrHistogram: exact below 16 ns, then 16 buckets per power of two
+struct LatencyHistogram {
+    atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+    atomic<uint64_t> count;
+    atomic<uint64_t> totalNs;
+    atomic<uint64_t> maxNs;
+    
+    static size_t bucketFor(uint64_t ns) {
+        if (ns < (1u << HISTOGRAM_SUB_BUCKET_BITS)) return ns;
+        int magnitude = 63 - __builtin_clzll(ns);
+        if (magnitude > HISTOGRAM_MAX_MAGNITUDE) return HISTOGRAM_BUCKETS - 1;
+        int shift = magnitude - HISTOGRAM_SUB_BUCKET_BITS;
+        return ((shift + 1) << HISTOGRAM_SUB_BUCKET_BITS) + ((ns >> shift) & ((1u << HISTOGRAM_SUB_BUCKET_BITS) - 1));
     }
-    logEntry += message;
-    cout << logEntry << endl;
+    
+    // Highest latency that maps to the bucket, as HdrHistogram reports percentiles
+    static uint64_t bucketLimit(size_t index) {
+        if (index < (1u << HISTOGRAM_SUB_BUCKET_BITS)) return index;
+        int shift = static_cast<int>(index >> HISTOGRAM_SUB_BUCKET_BITS) - 1;
+        uint64_t lower = ((index & ((1u << HISTOGRAM_SUB_BUCKET_BITS) - 1)) | (1u << HISTOGRAM_SUB_BUCKET_BITS)) << shift;
+        return lower + (uint64_t(1) << shift) - 1;
+    }
+};
+
+// Only the owning thread writes a shard, so plain load/store replaces locked read-modify-write
+inline void bump(atomic<uint64_t>& counter, uint64_t amount = 1) {
+    counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
 }
 
-// Secure send function with error handling
-bool sendResponse(ClientSession& session, const string& response) {
-    if (send(session.socket, response.c_str(), response.size(), 0) < 0) {
-        log("Failed to send response to client", &session);
-        return false;
+struct MetricsShard {
+    unique_ptr<LatencyHistogram[]> commands{new LatencyHistogram[ALLOWED_COMMANDS.size() + 1]()}; // Last slot: rejected
+    atomic<uint64_t> bytesSent{0};
+    atomic<uint64_t> transfersCompleted{0};
+    atomic<uint64_t> transfersAborted{0};
+    atomic<uint64_t> authFailures{0};
+};
+
+// Counters and histograms recorded per thread without contention, summed only when read
+class Metrics {
+public:
+    atomic<long> activeSessions{0};
+    atomic<long> activeTransfers{0};
+    atomic<uint64_t> sessionsTotal{0};
+    
+    void start() {
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, METRICS_SOCKET.c_str(), sizeof(address.sun_path) - 1);
+        unlink(METRICS_SOCKET.c_str()); // Left behind by a previous run
+        
+        if (listenFd < 0 || bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+            chmod(METRICS_SOCKET.c_str(), 0600) < 0 || listen(listenFd, 16) < 0) {
+            perror("Metrics socket setup failed");
+            exit(EXIT_FAILURE);
+        }
+        thread(&Metrics::serve, this).detach();
+    }
+    
+    void recordCommand(size_t commandIndex, uint64_t latencyNs) {
+        LatencyHistogram& histogram = shard().commands[commandIndex];
+        bump(histogram.buckets[LatencyHistogram::bucketFor(latencyNs)]);
+        bump(histogram.count);
+        bump(histogram.totalNs, latencyNs);
+        if (latencyNs > histogram.maxNs.load(memory_order_relaxed)) {
+            histogram.maxNs.store(latencyNs, memory_order_relaxed);
+        }
+    }
+    
+    void recordTransfer(uint64_t bytes, bool completed) {
+        MetricsShard& local = shard();
+        bump(local.bytesSent, bytes);
+        bump(completed ? local.transfersCompleted : local.transfersAborted);
+    }
+    
+    void recordAuthFailure() {
+        bump(shard().authFailures);
+    }
+    
+    uint64_t total(atomic<uint64_t> MetricsShard::*counter) {
+        uint64_t sum = 0;
+        lock_guard<mutex> guard(registryMutex);
+        for (auto& entry : shards) sum += ((*entry).*counter).load(memory_order_relaxed);
+        return sum;
+    }
+    
+    // Plain-text exposition, one "name{labels} value" per line
+    string render() {
+        stringstream out;
+        out << "ftp_active_sessions " << activeSessions.load(memory_order_relaxed) << "\n"
+            << "ftp_active_transfers " << activeTransfers.load(memory_order_relaxed) << "\n"
+            << "ftp_sessions_total " << sessionsTotal.load(memory_order_relaxed) << "\n"
+            << "ftp_bytes_sent_total " << total(&MetricsShard::bytesSent) << "\n"
+            << "ftp_transfers_total{result=\"complete\"} " << total(&MetricsShard::transfersCompleted) << "\n"
+            << "ftp_transfers_total{result=\"aborted\"} " << total(&MetricsShard::transfersAborted) << "\n"
+            << "ftp_auth_failures_total " << total(&MetricsShard::authFailures) << "\n";
+        
+        for (size_t i = 0; i <= ALLOWED_COMMANDS.size(); ++i) {
+            vector<uint64_t> buckets(HISTOGRAM_BUCKETS, 0);
+            uint64_t count = 0, totalNs = 0, maxNs = 0;
+            {
+                lock_guard<mutex> guard(registryMutex);
+                for (auto& entry : shards) {
+                    const LatencyHistogram& histogram = entry->commands[i];
+                    for (size_t b = 0; b < HISTOGRAM_BUCKETS; ++b) buckets[b] += histogram.buckets[b].load(memory_order_relaxed);
+                    count += histogram.count.load(memory_order_relaxed);
+                    totalNs += histogram.totalNs.load(memory_order_relaxed);
+                    maxNs = max(maxNs, histogram.maxNs.load(memory_order_relaxed));
+                }
+            }
+            if (count == 0) continue;
+            
+            string label = "{cmd=\"" + (i < ALLOWED_COMMANDS.size() ? ALLOWED_COMMANDS[i] : string("rejected")) + "\"";
+            out << "ftp_command_total" << label << "} " << count << "\n"
+                << "ftp_command_latency_ns" << label << ",stat=\"mean\"} " << totalNs / count << "\n";
+            for (double quantile : {0.5, 0.9, 0.99, 0.999}) {
+                out << "ftp_command_latency_ns" << label << ",quantile=\"" << quantile << "\"} "
+                    << min(percentile(buckets, count, quantile), maxNs) << "\n";
+            }
+            out << "ftp_command_latency_ns" << label << ",stat=\"max\"} " << maxNs << "\n";
+        }
+        return out.str();
+    }
+
+private:
+    int listenFd = -1;
+    mutex registryMutex;
+    vector<shared_ptr<MetricsShard>> shards;
+    
+    MetricsShard& shard() {
+        static thread_local shared_ptr<MetricsShard> local = registerShard();
+        return *local;
+    }
+    
+    shared_ptr<MetricsShard> registerShard() {
+        auto local = make_shared<MetricsShard>();
+        lock_guard<mutex> guard(registryMutex);
+        shards.push_back(local);
+        return local;
+    }
+    
+    static uint64_t percentile(const vector<uint64_t>& buckets, uint64_t count, double quantile) {
+        uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(quantile * count + 0.5));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < buckets.size(); ++b) {
+            seen += buckets[b];
+            if (seen >= rank) return LatencyHistogram::bucketLimit(b);
+        }
+        return LatencyHistogram::bucketLimit(buckets.size() - 1);
+    }
+    
+    // Each connection receives one snapshot and is closed
+    void serve() {
+        while (true) {
+            int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno != EINTR) this_thread::sleep_for(chrono::milliseconds(100));
+                continue;
+            }
+            string text = render();
+            for (size_t written = 0; written < text.size(); ) {
+                ssize_t n = send(client, text.data() + written, text.size() - written, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                written += n;
+            }
+            close(client);
+        }
+    }
+};
+
+Metrics metrics;
+
+// Push queued replies with as few writev() calls as the socket allows
+bool flushOutput(ClientSession& session) {
+    struct iovec iov[MAX_REPLY_IOVECS];
+    
+    while (!session.outQueue.empty()) {
+        int count = 0;
+        for (auto it = session.outQueue.begin(); it != session.outQueue.end() && count < MAX_REPLY_IOVECS; ++it) {
+            size_t skip = count == 0 ? session.outOffset : 0;
+            const string& bytes = it->bytes();
+            iov[count].iov_base = const_cast<char*>(bytes.data()) + skip;
+            iov[count].iov_len = bytes.size() - skip;
+            ++count;
+        }
+        
+        ssize_t sent = writev(session.socket, iov, count);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true; // Resumed on EPOLLOUT
+            if (errno == EINTR) continue;
+            log("Failed to send response to client", &session);
+            session.closing = true;
+            return false;
+        }
+        
+        size_t remaining = sent;
+        while (remaining > 0) {
+            size_t pending = session.outQueue.front().bytes().size() - session.outOffset;
+            if (remaining < pending) {
+                session.outOffset += remaining;
+                break;
+            }
+            remaining -= pending;
+            session.outQueue.pop_front();
+            session.outOffset = 0;
+        }
     }
-    session.lastActivity = time(nullptr);
     return true;
 }
 
+// Queue a reply; the event loop flushes all replies of a read in one batch
+bool sendResponse(ClientSession& session, const string& response) {
+    if (response.empty()) return true;
+    session.outQueue.push_back(ReplyChunk{response, nullptr});
+    session.lastActivity = coarseNow();
+    return !session.closing;
+}
+
+// Queue a shared payload without copying it
+bool sendResponse(ClientSession& session, shared_ptr<const string> payload) {
+    if (payload->empty()) return true;
+    session.outQueue.push_back(ReplyChunk{string(), move(payload)});
+    session.lastActivity = coarseNow();
+    return !session.closing;
+}
+
 // Validate filename security
 bool isValidFilename(const string& filename) {
     if (filename.empty() || filename.length() > 255) return false;
@@ -80,270 +721,2874 @@ string getSecurePath(const string& filename) {
     return PUBLIC_FOLDER + "/" + filename;
 }
 
-// List files securely
-string listFilesSecure() {
-    DIR *dir;
-    struct dirent *ent;
-    stringstream fileList;
-    
-    if ((dir = opendir(PUBLIC_FOLDER.c_str())) != nullptr) {
-        while ((ent = readdir(dir)) != nullptr) {
-            string filename(ent->d_name);
-            if (filename != "." && filename != ".." && isValidFilename(filename)) {
-                fileList << filename << "\r\n";
-            }
+struct FileEntry {
+    off_t size;
+    time_t mtime;
+    long mtimeNsec;
+    ino_t inode;
+    bool regular;
+};
+
+// Immutable view of PUBLIC_FOLDER; replaced wholesale when the folder changes
+struct DirectorySnapshot {
+    unordered_map<string, FileEntry> files;
+    shared_ptr<const string> listing; // Pre-rendered LIST payload
+};
+
+// In-memory index of PUBLIC_FOLDER kept current by inotify
+class DirectoryIndex {
+public:
+    void start() {
+        inotifyFd = inotify_init1(IN_CLOEXEC);
+        if (inotifyFd < 0 ||
+            inotify_add_watch(inotifyFd, PUBLIC_FOLDER.c_str(),
+                              IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                              IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+            perror("inotify setup failed");
+            exit(EXIT_FAILURE);
         }
-        closedir(dir);
-        return fileList.str();
+        publish(rescan());
+        thread(&DirectoryIndex::watch, this).detach();
     }
-    return "550 Failed to list directory.\r\n";
-}
+    
+    shared_ptr<const DirectorySnapshot> snapshot() const { return atomic_load(&current); }
 
-// Get file size with security checks
-long getSecureFileSize(const string& filename) {
-    try {
-        string filepath = getSecurePath(filename);
+private:
+    int inotifyFd = -1;
+    shared_ptr<const DirectorySnapshot> current;
+    
+    static bool statEntry(const string& filename, FileEntry& entry) {
         struct stat stat_buf;
-        
-        if (stat(filepath.c_str(), &stat_buf) != 0) return -1;
-        if (!S_ISREG(stat_buf.st_mode)) return -1; // Not a regular file
-        if (stat_buf.st_size > MAX_FILE_SIZE) return -2; // File too large
-        
-        return stat_buf.st_size;
-    } catch (...) {
-        return -1;
+        if (stat((PUBLIC_FOLDER + "/" + filename).c_str(), &stat_buf) != 0) return false;
+        entry = FileEntry{stat_buf.st_size, stat_buf.st_mtim.tv_sec, stat_buf.st_mtim.tv_nsec,
+                          stat_buf.st_ino, S_ISREG(stat_buf.st_mode)};
+        return true;
     }
-}
-
-// Simple authentication (in real implementation, use proper password hashing)
-bool authenticate(const string& user, const string& pass) {
-    // This is just an example - store credentials securely in production
-    return (user == "ftpuser" && pass == "2a10$N9qo8uLOickgx2ZMRZoMy..."); // Example hashed password
-}
-
-// Handle client connection securely
-void handleClientSecure(ClientSession session) {
-    char buffer[MAX_COMMAND_LENGTH + 1] = {0};
     
-    sendResponse(session, "220 Welcome to Secure FTP Server\r\n");
-    
-    while (true) {
-        // Check session timeout
-        if (difftime(time(nullptr), session.lastActivity) > SESSION_TIMEOUT) {
-            sendResponse(session, "421 Session timeout\r\n");
-            log("Session timed out", &session);
-            break;
-        }
-        
-        memset(buffer, 0, sizeof(buffer));
-        int valread = recv(session.socket, buffer, MAX_COMMAND_LENGTH, 0);
-        
-        if (valread <= 0) {
-            log(valread == 0 ? "Client disconnected" : "Read error", &session);
-            break;
-        }
-        
-        string command(buffer);
-        command = command.substr(0, command.find('\r')); // Remove CRLF
-        
-        // Basic command validation
-        if (command.length() > MAX_COMMAND_LENGTH) {
-            sendResponse(session, "500 Command too long\r\n");
-            continue;
-        }
-        
-        string cmd = command.substr(0, command.find(' '));
-        transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
-        
-        // Check if command is allowed
-        if (find(ALLOWED_COMMANDS.begin(), ALLOWED_COMMANDS.end(), cmd) == ALLOWED_COMMANDS.end()) {
-            sendResponse(session, "500 Unknown command\r\n");
-            continue;
-        }
+    static shared_ptr<DirectorySnapshot> rescan() {
+        auto snapshot = make_shared<DirectorySnapshot>();
+        DIR *dir;
+        struct dirent *ent;
         
-        log("Command: " + command, &session);
-        
-        if (cmd == "QUIT") {
-            sendResponse(session, "221 Goodbye\r\n");
-            break;
+        if ((dir = opendir(PUBLIC_FOLDER.c_str())) == nullptr) {
+            snapshot->listing = make_shared<const string>("550 Failed to list directory.\r\n");
+            return snapshot;
         }
-        else if (cmd == "USER") {
-            if (command.length() > 5) {
-                session.username = command.substr(5);
-                sendResponse(session, "331 Password required\r\n");
-            } else {
-                sendResponse(session, "501 Syntax error in parameters\r\n");
-            }
-        }
-        else if (cmd == "PASS") {
-            if (session.username.empty()) {
-                sendResponse(session, "503 Login with USER first\r\n");
-            } else if (command.length() > 5) {
-                string password = command.substr(5);
-                if (authenticate(session.username, password)) {
-                    session.authenticated = true;
-                    sendResponse(session, "230 Login successful\r\n");
-                    log("User authenticated", &session);
-                } else {
-                    sendResponse(session, "530 Login incorrect\r\n");
-                    log("Failed authentication attempt", &session);
-                }
-            } else {
-                sendResponse(session, "501 Syntax error in parameters\r\n");
+        while ((ent = readdir(dir)) != nullptr) {
+            string filename(ent->d_name);
+            FileEntry entry;
+            if (filename != "." && filename != ".." && isValidFilename(filename) && statEntry(filename, entry)) {
+                snapshot->files.emplace(filename, entry);
             }
         }
-        else if (!session.authenticated) {
-            sendResponse(session, "530 Not logged in\r\n");
+        closedir(dir);
+        return snapshot;
+    }
+    
+    // Render the LIST payload once per change instead of once per request
+    void publish(shared_ptr<DirectorySnapshot> snapshot) {
+        if (!snapshot->listing) {
+            vector<const string*> names;
+            names.reserve(snapshot->files.size());
+            for (const auto& file : snapshot->files) names.push_back(&file.first);
+            sort(names.begin(), names.end(), [](const string* a, const string* b) { return *a < *b; });
+            
+            string listing;
+            for (const string* name : names) listing += *name + "\r\n";
+            snapshot->listing = make_shared<const string>(move(listing));
         }
-        else if (cmd == "LIST") {
-            string files = listFilesSecure();
-            sendResponse(session, "150 Here comes the directory listing\r\n");
-            sendResponse(session, files);
-            sendResponse(session, "226 Directory send OK\r\n");
-        }
-        else if (cmd == "RETR") {
-            if (command.length() > 5) {
-                string filename = command.substr(5);
-                try {
-                    string filepath = getSecurePath(filename);
-                    long fileSize = getSecureFileSize(filename);
-                    
-                    if (fileSize == -1) {
-                        sendResponse(session, "550 File not found or access denied\r\n");
-                    } else if (fileSize == -2) {
-                        sendResponse(session, "552 Requested file size exceeds limit\r\n");
-                    } else {
-                        ifstream file(filepath, ios::binary);
-                        if (file) {
-                            sendResponse(session, "150 Opening BINARY mode data connection for " + filename + "\r\n");
-                            
-                            // Stream file in chunks to avoid memory issues
-                            vector<char> buffer(1024 * 1024); // 1MB buffer
-                            while (file.read(buffer.data(), buffer.size())) {
-                                if (send(session.socket, buffer.data(), file.gcount(), 0) < 0) {
-                                    throw runtime_error("Send failed");
-                                }
-                            }
-                            // Send remaining data
-                            if (file.gcount() > 0) {
-                                send(session.socket, buffer.data(), file.gcount(), 0);
-                            }
-                            
-                            sendResponse(session, "226 Transfer complete\r\n");
-                        } else {
-                            sendResponse(session, "550 Could not open file\r\n");
-                        }
+        atomic_store(&current, shared_ptr<const DirectorySnapshot>(move(snapshot)));
+    }
+    
+    // Collect events in short batches and apply them to a copy of the current snapshot
+    void watch() {
+        alignas(struct inotify_event) char buffer[64 * 1024];
+        
+        while (true) {
+            unordered_set<string> changed;
+            bool fullRescan = false;
+            int timeout = -1; // Block until the first event, then coalesce briefly
+            
+            while (true) {
+                struct pollfd pfd = {inotifyFd, POLLIN, 0};
+                int ready = poll(&pfd, 1, timeout);
+                if (ready < 0 && errno == EINTR) continue;
+                if (ready <= 0) break;
+                
+                ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+                if (length <= 0) break;
+                for (char* ptr = buffer; ptr < buffer + length; ) {
+                    const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+                    if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                        fullRescan = true;
+                    } else if (event->len > 0) {
+                        changed.insert(event->name);
                     }
-                } catch (const exception& e) {
-                    sendResponse(session, "550 Access denied\r\n");
-                    log(string("File access denied: ") + e.what(), &session);
+                    ptr += sizeof(struct inotify_event) + event->len;
                 }
-            } else {
-                sendResponse(session, "501 Syntax error in parameters\r\n");
-            }
-        }
-        else if (cmd == "SIZE") {
-            if (command.length() > 5) {
-                string filename = command.substr(5);
-                try {
-                    long size = getSecureFileSize(filename);
-                    if (size >= 0) {
-                        sendResponse(session, "213 " + to_string(size) + "\r\n");
-                    } else if (size == -2) {
-                        sendResponse(session, "552 File too large\r\n");
-                    } else {
-                        sendResponse(session, "550 File not found or access denied\r\n");
-                    }
-                } catch (...) {
-                    sendResponse(session, "550 Access denied\r\n");
+                timeout = INDEX_COALESCE_MS;
+            }
+            
+            if (fullRescan) {
+                publish(rescan());
+                continue;
+            }
+            
+            auto next = make_shared<DirectorySnapshot>();
+            next->files = snapshot()->files;
+            for (const string& filename : changed) {
+                FileEntry entry;
+                if (isValidFilename(filename) && statEntry(filename, entry)) {
+                    next->files[filename] = entry;
+                } else {
+                    next->files.erase(filename);
                 }
-            } else {
-                sendResponse(session, "501 Syntax error in parameters\r\n");
             }
+            publish(move(next));
         }
     }
+};
+
+DirectoryIndex directoryIndex;
+
+// Get file size with security checks, answered from the directory index
+long getSecureFileSize(const string& filename) {
+    if (!isValidFilename(filename)) return -1;
+    
+    auto snapshot = directoryIndex.snapshot();
+    auto it = snapshot->files.find(filename);
+    if (it == snapshot->files.end()) return -1;
+    if (!it->second.regular) return -1; // Not a regular file
+    if (static_cast<size_t>(it->second.size) > MAX_FILE_SIZE) return -2; // File too large
     
-    close(session.socket);
-    log("Connection closed", &session);
+    return it->second.size;
 }
 
-int main() {
-    int serverSocket, clientSocket;
-    struct sockaddr_in serverAddr, clientAddr;
-    socklen_t clientAddrLen = sizeof(clientAddr);
+// A whole file mapped into memory; its descriptor stays open for sendfile()
+struct CachedFile {
+    int fd;
+    off_t size;
+    const char* data;
+    FileEntry identity; // Inode, size and mtime the mapping was taken from
     
-    // Create public folder with secure permissions
-    mkdir(PUBLIC_FOLDER.c_str(), 0755); // Restrictive permissions
+    CachedFile(int fd, off_t size, const char* data, const FileEntry& identity)
+        : fd(fd), size(size), data(data), identity(identity) {}
+    CachedFile(const CachedFile&) = delete;
+    CachedFile& operator=(const CachedFile&) = delete;
+    ~CachedFile() {
+        munmap(const_cast<char*>(data), size);
+        close(fd);
+    }
+};
+
+// Hot-file content cache: sharded LRU keyed by filename and validated against the index entry
+class FileCache {
+public:
+    // Returns the cached contents, loading them on a miss; nullptr when the file is not cacheable
+    shared_ptr<const CachedFile> acquire(const string& filename) {
+        auto snapshot = directoryIndex.snapshot();
+        auto it = snapshot->files.find(filename);
+        if (it == snapshot->files.end() || !it->second.regular) return nullptr;
+        const FileEntry& entry = it->second;
+        
+        Shard& shard = shards[hash<string>()(filename) % FILE_CACHE_SHARDS];
+        {
+            lock_guard<mutex> guard(shard.lock);
+            auto found = shard.entries.find(filename);
+            if (found != shard.entries.end()) {
+                if (sameFile(found->second.file->identity, entry)) {
+                    shard.order.splice(shard.order.begin(), shard.order, found->second.position);
+                    hits.fetch_add(1, memory_order_relaxed);
+                    return found->second.file;
+                }
+                removeLocked(shard, found); // Rewritten since it was cached
+            }
+        }
+        misses.fetch_add(1, memory_order_relaxed);
+        
+        if (entry.size == 0 || entry.size > FILE_CACHE_MAX_FILE) return nullptr;
+        shared_ptr<const CachedFile> file = load(filename, entry);
+        if (!file) return nullptr;
+        
+        lock_guard<mutex> guard(shard.lock);
+        auto found = shard.entries.find(filename);
+        if (found != shard.entries.end()) removeLocked(shard, found); // Lost a race with another loader
+        shard.order.push_front(filename);
+        shard.entries[filename] = Slot{file, shard.order.begin()};
+        shard.bytes += file->size;
+        while (shard.bytes > FILE_CACHE_BUDGET / FILE_CACHE_SHARDS && shard.order.size() > 1) {
+            removeLocked(shard, shard.entries.find(shard.order.back()));
+            evictions.fetch_add(1, memory_order_relaxed);
+        }
+        return file;
+    }
     
-    // Create socket
-    if ((serverSocket = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
+    // Cached file names, most recently used first within each shard; handed to a successor process
+    vector<string> hotFiles() {
+        vector<string> names;
+        for (Shard& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            names.insert(names.end(), shard.order.begin(), shard.order.end());
+        }
+        return names;
     }
     
-    // Set socket options
-    int opt = 1;
-    if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
-        perror("Setsockopt failed");
-        exit(EXIT_FAILURE);
+    string stats() {
+        size_t bytes = 0;
+        for (Shard& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            bytes += shard.bytes;
+        }
+        return to_string(hits.load()) + " hits, " + to_string(misses.load()) + " misses, " +
+               to_string(evictions.load()) + " evictions, " + to_string(bytes) + " bytes cached";
     }
     
-    // Set receive timeout
-    struct timeval tv;
-    tv.tv_sec = 30;
-    tv.tv_usec = 0;
-    setsockopt(serverSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
+private:
+    struct Slot {
+        shared_ptr<const CachedFile> file;
+        list<string>::iterator position;
+    };
+    struct Shard {
+        mutex lock;
+        list<string> order; // Most recently used first
+        unordered_map<string, Slot> entries;
+        size_t bytes = 0;
+    };
     
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(FTP_PORT);
+    Shard shards[FILE_CACHE_SHARDS];
+    atomic<uint64_t> hits{0};
+    atomic<uint64_t> misses{0};
+    atomic<uint64_t> evictions{0};
     
-    // Bind socket
-    if (bind(serverSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
-        perror("Bind failed");
-        exit(EXIT_FAILURE);
+    static bool sameFile(const FileEntry& a, const FileEntry& b) {
+        return a.inode == b.inode && a.size == b.size && a.mtime == b.mtime && a.mtimeNsec == b.mtimeNsec;
     }
     
-    // Listen for connections
-    if (listen(serverSocket, MAX_CLIENTS) < 0) {
-        perror("Listen failed");
-        exit(EXIT_FAILURE);
+    // Transfers still holding the entry keep it alive until they finish
+    static void removeLocked(Shard& shard, unordered_map<string, Slot>::iterator found) {
+        shard.bytes -= found->second.file->size;
+        shard.order.erase(found->second.position);
+        shard.entries.erase(found);
     }
     
-    log("Secure FTP Server started on port " + to_string(FTP_PORT));
-    log("Sharing files from: " + PUBLIC_FOLDER);
-    
-    vector<thread> clientThreads;
-    
-    while (true) {
-        // Accept new connection
-        if ((clientSocket = accept(serverSocket, (struct sockaddr *)&clientAddr, &clientAddrLen)) < 0) {
-            perror("Accept failed");
-            continue;
-        }
-        
-        ClientSession session;
-        session.socket = clientSocket;
-        session.clientIP = inet_ntoa(clientAddr.sin_addr);
-        session.authenticated = false;
-        session.lastActivity = time(nullptr);
-        
-        log("New connection", &session);
+    static shared_ptr<const CachedFile> load(const string& filename, const FileEntry& entry) {
+        int fd = open(getSecurePath(filename).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return nullptr;
         
-        // Handle client in a new thread
-        clientThreads.emplace_back(handleClientSecure, session);
+        struct stat stat_buf;
+        if (fstat(fd, &stat_buf) != 0 || stat_buf.st_ino != entry.inode || stat_buf.st_size != entry.size) {
+            close(fd); // Changed since the index saw it; serve it uncached this time
+            return nullptr;
+        }
+        void* mapping = mmap(nullptr, entry.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            return nullptr;
+        }
+        // Runs on the control loop: start readahead instead of waiting for the disk here.
+        // Pages still missing are faulted in later by the data worker that sends them.
+        madvise(mapping, entry.size, MADV_WILLNEED);
+        return make_shared<const CachedFile>(fd, entry.size, static_cast<const char*>(mapping), entry);
+    }
+};
+
+FileCache fileCache;
+
+// A precompressed copy of a public file, kept in ZCACHE_FOLDER
+struct Sidecar {
+    string path;
+    FileEntry identity; // Source file the sidecar was built from
+    off_t compressedSize;
+    long cpuUs;         // Compression cost, saved again on every hit
+};
+
+// Lazily built zlib sidecars for MODE Z: the first compressed download of a file queues a
+// background build, later ones send the sidecar with sendfile() and spend no CPU on deflate.
+// Sidecar files are named "<pid>-<file>.z", so a draining predecessor and its successor never
+// write, replace or unlink each other's files.
+class SidecarCache {
+public:
+    void start() {
+        mkdir(ZCACHE_FOLDER.c_str(), 0700);
+        // Sidecars carry no validator on disk, so leftovers from exited processes are dropped;
+        // a predecessor that is still draining keeps serving its own
+        if (DIR* dir = opendir(ZCACHE_FOLDER.c_str())) {
+            while (struct dirent* item = readdir(dir)) {
+                if (item->d_name[0] == '.') continue;
+                pid_t owner = static_cast<pid_t>(atol(item->d_name));
+                bool ownerRunning = owner > 0 && (kill(owner, 0) == 0 || errno == EPERM);
+                if (!ownerRunning) unlink((ZCACHE_FOLDER + "/" + item->d_name).c_str());
+            }
+            closedir(dir);
+        }
+        thread(&SidecarCache::buildQueued, this).detach();
+    }
+    
+    // Open the sidecar of an unchanged file; on a miss queue a build and return -1
+    int open(const string& filename, off_t& compressedSize) {
+        auto snapshot = directoryIndex.snapshot();
+        auto it = snapshot->files.find(filename);
+        if (it == snapshot->files.end() || !it->second.regular) return -1;
+        const FileEntry& entry = it->second;
         
-        // Clean up finished threads
-        for (auto it = clientThreads.begin(); it != clientThreads.end(); ) {
-            if (it->joinable()) {
-                it->join();
-                it = clientThreads.erase(it);
-            } else {
-                ++it;
+        lock_guard<mutex> guard(cacheMutex);
+        auto found = ready.find(filename);
+        if (found != ready.end()) {
+            const Sidecar& sidecar = found->second;
+            if (sameFile(sidecar.identity, entry)) {
+                int fd = ::open(sidecar.path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd >= 0) {
+                    compressedSize = sidecar.compressedSize;
+                    hits++;
+                    cpuSavedUs += sidecar.cpuUs;
+                    return fd;
+                }
             }
+            drop(found); // Source changed since the build
         }
+        
+        misses++;
+        if (entry.size >= ZCACHE_MIN_FILE && building.insert(filename).second) {
+            queue.push_back(filename);
+            queueReady.notify_one();
+        }
+        return -1;
+    }
+    
+    // Remove this process's sidecars; the successor builds its own
+    void discard() {
+        lock_guard<mutex> guard(cacheMutex);
+        while (!ready.empty()) drop(ready.begin());
+    }
+    
+    string stats() {
+        lock_guard<mutex> guard(cacheMutex);
+        long ratio = rawBytes > 0 ? static_cast<long>(100.0 * compressedBytes / rawBytes) : 0;
+        return to_string(ready.size()) + " sidecars at " + to_string(ratio) + "% of original size, " +
+               to_string(hits) + " hits, " + to_string(misses) + " misses, " +
+               to_string(cpuSavedUs / 1000) + " ms CPU saved";
+    }
+
+private:
+    mutex cacheMutex;
+    condition_variable queueReady;
+    unordered_map<string, Sidecar> ready;
+    unordered_set<string> building; // Queued or in progress
+    deque<string> queue;
+    uint64_t rawBytes = 0;
+    uint64_t compressedBytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t cpuSavedUs = 0;
+    
+    static bool sameFile(const FileEntry& a, const FileEntry& b) {
+        return a.inode == b.inode && a.size == b.size && a.mtime == b.mtime && a.mtimeNsec == b.mtimeNsec;
+    }
+    
+    void drop(unordered_map<string, Sidecar>::iterator found) {
+        unlink(found->second.path.c_str()); // Transfers that still have it open keep reading it
+        rawBytes -= found->second.identity.size;
+        compressedBytes -= found->second.compressedSize;
+        ready.erase(found);
+    }
+    
+    void buildQueued() {
+        while (true) {
+            string filename;
+            {
+                unique_lock<mutex> lock(cacheMutex);
+                queueReady.wait(lock, [this] { return !queue.empty(); });
+                filename = move(queue.front());
+                queue.pop_front();
+            }
+            
+            Sidecar sidecar;
+            bool built = compress(filename, sidecar);
+            
+            lock_guard<mutex> guard(cacheMutex);
+            building.erase(filename);
+            if (!built) continue;
+            auto found = ready.find(filename);
+            if (found != ready.end()) drop(found);
+            ready[filename] = sidecar;
+            rawBytes += sidecar.identity.size;
+            compressedBytes += sidecar.compressedSize;
+        }
+    }
+    
+    static FileEntry identityOf(const struct stat& stat_buf) {
+        return FileEntry{stat_buf.st_size, stat_buf.st_mtim.tv_sec, stat_buf.st_mtim.tv_nsec, stat_buf.st_ino, true};
+    }
+    
+    // Deflate the whole file into a temporary sidecar and publish it by rename
+    static bool compress(const string& filename, Sidecar& sidecar) {
+        string sourcePath;
+        try {
+            sourcePath = getSecurePath(filename);
+        } catch (const exception&) {
+            return false;
+        }
+        int source = ::open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat before;
+        if (source < 0 || fstat(source, &before) != 0) {
+            if (source >= 0) close(source);
+            return false;
+        }
+        
+        sidecar.path = ZCACHE_FOLDER + "/" + to_string(getpid()) + "-" + filename + ".z";
+        string temporary = sidecar.path + ".tmp";
+        int target = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        struct timespec cpuStart, cpuEnd;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuStart);
+        
+        z_stream stream = {};
+        bool ok = target >= 0 && deflateInit(&stream, ZCACHE_LEVEL) == Z_OK;
+        vector<char> input(TRANSFER_CHUNK_SIZE), output(TRANSFER_CHUNK_SIZE);
+        off_t compressedSize = 0;
+        int flush = Z_NO_FLUSH;
+        while (ok && flush != Z_FINISH) {
+            ssize_t bytesRead = read(source, input.data(), input.size());
+            if (bytesRead < 0) {
+                ok = false;
+                break;
+            }
+            flush = bytesRead == 0 ? Z_FINISH : Z_NO_FLUSH;
+            stream.next_in = reinterpret_cast<Bytef*>(input.data());
+            stream.avail_in = bytesRead;
+            do {
+                stream.next_out = reinterpret_cast<Bytef*>(output.data());
+                stream.avail_out = output.size();
+                deflate(&stream, flush);
+                size_t produced = output.size() - stream.avail_out;
+                ok = ok && write(target, output.data(), produced) == static_cast<ssize_t>(produced);
+                compressedSize += produced;
+            } while (ok && stream.avail_out == 0);
+        }
+        deflateEnd(&stream);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
+        
+        // A rewrite during the build would leave a sidecar that matches neither version
+        struct stat after;
+        ok = ok && fstat(source, &after) == 0 && sameFile(identityOf(before), identityOf(after));
+        close(source);
+        if (target >= 0) close(target);
+        if (!ok || rename(temporary.c_str(), sidecar.path.c_str()) != 0) {
+            unlink(temporary.c_str());
+            return false;
+        }
+        
+        sidecar.identity = identityOf(before);
+        sidecar.compressedSize = compressedSize;
+        sidecar.cpuUs = (cpuEnd.tv_sec - cpuStart.tv_sec) * 1000000L + (cpuEnd.tv_nsec - cpuStart.tv_nsec) / 1000;
+        return true;
+    }
+};
+
+SidecarCache sidecarCache;
+
+// Authentication: logins are checked against scrypt hashes from CREDENTIALS_FILE.
+// One login; fields mirror a credentials file line "user:scrypt:N:r:p:salthex:hashhex"
+struct Credential {
+    string username;
+    uint64_t costN = 0;
+    uint32_t blockSize = 0;
+    uint32_t parallelism = 0;
+    vector<unsigned char> salt;
+    vector<unsigned char> hash;
+};
+
+string toHex(const unsigned char* data, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    string out;
+    for (size_t i = 0; i < length; ++i) {
+        out += digits[data[i] >> 4];
+        out += digits[data[i] & 0x0f];
+    }
+    return out;
+}
+
+bool fromHex(const string& text, vector<unsigned char>& out) {
+    if (text.size() % 2 != 0) return false;
+    out.clear();
+    for (size_t i = 0; i < text.size(); i += 2) {
+        if (!isxdigit(static_cast<unsigned char>(text[i])) || !isxdigit(static_cast<unsigned char>(text[i + 1]))) return false;
+        out.push_back(static_cast<unsigned char>(stoi(text.substr(i, 2), nullptr, 16)));
+    }
+    return true;
+}
+
+// Memory-hard derivation; slow by design, so it only ever runs on the auth workers
+bool deriveKey(const string& password, const Credential& params, vector<unsigned char>& key) {
+    key.assign(params.hash.empty() ? SCRYPT_KEY_LENGTH : params.hash.size(), 0);
+    return EVP_PBE_scrypt(password.data(), password.size(), params.salt.data(), params.salt.size(),
+                          params.costN, params.blockSize, params.parallelism, SCRYPT_MAX_MEMORY,
+                          key.data(), key.size()) == 1;
+}
+
+// Credentials loaded once at startup into an open-addressing table keyed by username
+class CredentialStore {
+public:
+    void load(const string& path) {
+        ifstream file(path);
+        if (!file) {
+            log("Credentials file " + path + " not found; every login will be refused");
+        }
+        
+        vector<Credential> entries;
+        string line;
+        int lineNumber = 0;
+        while (getline(file, line)) {
+            ++lineNumber;
+            if (line.empty() || line[0] == '#') continue;
+            Credential credential;
+            if (parseLine(line, credential)) {
+                entries.push_back(move(credential));
+            } else {
+                log("Ignoring malformed credentials line " + to_string(lineNumber));
+            }
+        }
+        
+        auto table = make_shared<Table>();
+        size_t capacity = 16;
+        while (capacity < entries.size() * 2) capacity *= 2; // Load factor at most 1/2 keeps probes short
+        table->slots.assign(capacity, Credential());
+        for (Credential& entry : entries) {
+            size_t index = slotFor(*table, entry.username);
+            if (table->slots[index].username.empty()) table->slots[index] = move(entry);
+        }
+        
+        // Unknown users are checked against a decoy so they cost the same time as real ones
+        Credential& decoy = table->decoy;
+        decoy.costN = SCRYPT_N;
+        decoy.blockSize = SCRYPT_R;
+        decoy.parallelism = SCRYPT_P;
+        decoy.salt.resize(SCRYPT_SALT_LENGTH);
+        decoy.hash.resize(SCRYPT_KEY_LENGTH);
+        RAND_bytes(decoy.salt.data(), decoy.salt.size());
+        RAND_bytes(decoy.hash.data(), decoy.hash.size());
+        atomic_store(&current, shared_ptr<const Table>(move(table))); // Checks in progress keep the old table
+        log("Loaded " + to_string(entries.size()) + " credentials");
+    }
+    
+    bool verify(const string& username, const string& password) const {
+        shared_ptr<const Table> table = atomic_load(&current);
+        if (!table) return false;
+        const Credential& entry = table->slots[slotFor(*table, username)];
+        bool known = !entry.username.empty();
+        const Credential& target = known ? entry : table->decoy;
+        
+        vector<unsigned char> key;
+        if (!deriveKey(password, target, key)) return false;
+        return known && CRYPTO_memcmp(key.data(), target.hash.data(), key.size()) == 0;
+    }
+    
+    static bool parseLine(const string& line, Credential& credential) {
+        vector<string> fields;
+        stringstream stream(line);
+        string field;
+        while (getline(stream, field, ':')) fields.push_back(field);
+        if (fields.size() != 7 || fields[0].empty() || fields[1] != "scrypt") return false;
+        
+        try {
+            credential.username = fields[0];
+            credential.costN = stoull(fields[2]);
+            credential.blockSize = stoul(fields[3]);
+            credential.parallelism = stoul(fields[4]);
+        } catch (const exception&) {
+            return false;
+        }
+        return fromHex(fields[5], credential.salt) && fromHex(fields[6], credential.hash) &&
+               !credential.salt.empty() && !credential.hash.empty();
+    }
+
+private:
+    struct Table {
+        vector<Credential> slots;
+        Credential decoy;
+    };
+    shared_ptr<const Table> current; // Replaced wholesale by load()
+    
+    // Slot holding the username, or the empty slot where it would go
+    static size_t slotFor(const Table& table, const string& username) {
+        const vector<Credential>& slots = table.slots;
+        size_t mask = slots.size() - 1;
+        size_t index = hash<string>()(username) & mask;
+        while (!slots[index].username.empty() && slots[index].username != username) index = (index + 1) & mask;
+        return index;
+    }
+};
+
+CredentialStore credentialStore;
+
+void notifyLoginResult(EventLoop* loop, int controlSocket, uint64_t sessionId, bool accepted);
+
+// A PASS waiting for verification
+struct LoginRequest {
+    EventLoop* loop;
+    int controlSocket;
+    uint64_t sessionId;
+    string username;
+    string password;
+};
+
+// Bounded pool that runs the KDF off the event loops; beyond the queue limit logins are refused
+class AuthWorkerPool {
+public:
+    void start(unsigned int count) {
+        for (unsigned int i = 0; i < count; ++i) thread(&AuthWorkerPool::work, this).detach();
+    }
+    
+    bool submit(LoginRequest request) {
+        {
+            lock_guard<mutex> guard(queueMutex);
+            if (queue.size() >= AUTH_QUEUE_LIMIT) return false;
+            queue.push_back(move(request));
+        }
+        queueReady.notify_one();
+        return true;
+    }
+
+private:
+    mutex queueMutex;
+    condition_variable queueReady;
+    deque<LoginRequest> queue;
+    
+    void work() {
+        while (true) {
+            LoginRequest request;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueReady.wait(lock, [this] { return !queue.empty(); });
+                request = move(queue.front());
+                queue.pop_front();
+            }
+            bool accepted = credentialStore.verify(request.username, request.password);
+            OPENSSL_cleanse(&request.password[0], request.password.size());
+            notifyLoginResult(request.loop, request.controlSocket, request.sessionId, accepted);
+        }
+    }
+};
+
+AuthWorkerPool authWorkers;
+
+// Append a new scrypt entry for username to the credentials file; the password is read from stdin
+int addUser(const string& username) {
+    if (username.empty() || username.find(':') != string::npos) {
+        cerr << "Invalid username" << endl;
+        return 1;
+    }
+    string password;
+    if (!getline(cin, password) || password.empty()) {
+        cerr << "No password given on stdin" << endl;
+        return 1;
+    }
+    
+    Credential credential;
+    credential.username = username;
+    credential.costN = SCRYPT_N;
+    credential.blockSize = SCRYPT_R;
+    credential.parallelism = SCRYPT_P;
+    credential.salt.resize(SCRYPT_SALT_LENGTH);
+    vector<unsigned char> key;
+    if (RAND_bytes(credential.salt.data(), credential.salt.size()) != 1 || !deriveKey(password, credential, key)) {
+        cerr << "Key derivation failed" << endl;
+        return 1;
+    }
+    
+    ofstream file(CREDENTIALS_FILE, ios::app);
+    file << username << ":scrypt:" << credential.costN << ":" << credential.blockSize << ":"
+         << credential.parallelism << ":" << toHex(credential.salt.data(), credential.salt.size()) << ":"
+         << toHex(key.data(), key.size()) << "\n";
+    chmod(CREDENTIALS_FILE.c_str(), 0600);
+    return file ? 0 : 1;
+}
+
+const char* transferMethodName(TransferMethod method) {
+    switch (method) {
+        case TransferMethod::Sendfile: return "sendfile";
+        case TransferMethod::Mmap: return "mmap";
+        case TransferMethod::Memory: return "memory";
+        case TransferMethod::Uring: return "io_uring";
+        case TransferMethod::Deflate: return "deflate";
+        default: return "copy";
+    }
+}
+
+// Pick the cheapest way to move bytes [start, end) of the file to the socket
+void startFileTransfer(FileTransfer& transfer, int fd, off_t fileSize, off_t start, off_t end) {
+    transfer.fd = fd;
+    transfer.start = start;
+    transfer.offset = start;
+    transfer.end = end;
+    transfer.method = TransferMethod::Copy;
+    transfer.memory = nullptr;
+    transfer.mappedLength = 0;
+    transfer.started = chrono::steady_clock::now();
+    
+    if (!ZERO_COPY_TRANSFERS) return;
+    
+    transfer.method = TransferMethod::Sendfile;
+    // Runs on the control loop, so small files are only marked here and mapped by the data worker
+    if (fileSize > 0 && fileSize <= MMAP_TRANSFER_THRESHOLD) transfer.mappedLength = fileSize;
+}
+
+// Map a file marked by startFileTransfer(); falls back to sendfile if the mapping fails
+void mapFileTransfer(FileTransfer& transfer) {
+    if (transfer.owner || transfer.memory || transfer.mappedLength == 0) return;
+    void* mapping = mmap(nullptr, transfer.mappedLength, PROT_READ, MAP_PRIVATE, transfer.fd, 0);
+    if (mapping == MAP_FAILED) {
+        transfer.mappedLength = 0;
+        return;
+    }
+    madvise(mapping, transfer.mappedLength, MADV_WILLNEED);
+    transfer.memory = static_cast<const char*>(mapping);
+    if (transfer.method == TransferMethod::Sendfile) transfer.method = TransferMethod::Mmap;
+}
+
+// Serve a shared in-memory payload such as the LIST buffer
+void startBufferTransfer(FileTransfer& transfer, shared_ptr<const string> payload) {
+    transfer.fd = -1;
+    transfer.start = 0;
+    transfer.offset = 0;
+    transfer.end = payload->size();
+    transfer.method = TransferMethod::Memory;
+    transfer.memory = payload->data();
+    transfer.owner = move(payload);
+    transfer.started = chrono::steady_clock::now();
+}
+
+// Stream bytes [start, end) of a cached file: small ones from the mapping, large ones via sendfile
+void startCachedTransfer(FileTransfer& transfer, shared_ptr<const CachedFile> file, off_t start, off_t end) {
+    bool useMemory = !ZERO_COPY_TRANSFERS || file->size <= MMAP_TRANSFER_THRESHOLD;
+    transfer.fd = file->fd;
+    transfer.start = start;
+    transfer.offset = start;
+    transfer.end = end;
+    transfer.method = useMemory ? TransferMethod::Memory : TransferMethod::Sendfile;
+    transfer.memory = useMemory ? file->data : nullptr;
+    transfer.mappedLength = 0;
+    transfer.owner = move(file);
+    transfer.started = chrono::steady_clock::now();
+}
+
+// MODE Z without a sidecar: compress the prepared byte range while it is sent
+void startCompression(FileTransfer& transfer) {
+    transfer.deflater = shared_ptr<z_stream>(new z_stream(), [](z_stream* stream) {
+        deflateEnd(stream);
+        delete stream;
+    });
+    if (deflateInit(transfer.deflater.get(), ZLIB_STREAM_LEVEL) != Z_OK) transfer.deflater.reset();
+    transfer.method = TransferMethod::Deflate;
+}
+
+// Release the source and describe the achieved throughput
+string finishTransfer(FileTransfer& transfer, bool completed) {
+    if (!transfer.owner) {
+        if (transfer.mappedLength > 0 && transfer.memory) { // Mapped by mapFileTransfer()
+            munmap(const_cast<char*>(transfer.memory), transfer.mappedLength);
+        }
+        if (transfer.fd >= 0) close(transfer.fd);
+    }
+    transfer.memory = nullptr;
+    transfer.owner.reset();
+    transfer.fd = -1;
+    
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - transfer.started).count();
+    off_t bytes = transfer.offset - transfer.start;
+    metrics.recordTransfer(bytes, completed);
+    double megabytesPerSecond = seconds > 0 ? bytes / seconds / (1024 * 1024) : 0;
+    stringstream report;
+    report << (completed ? "Transfer complete: " : "Transfer aborted: ")
+           << bytes << " bytes in " << static_cast<long>(seconds * 1e6) << " us ("
+           << static_cast<long>(megabytesPerSecond) << " MB/s via " << transferMethodName(transfer.method) << ")";
+    return report.str();
+}
+
+enum class PumpResult { Done, Blocked, Failed, Paused };
+
+// Compress one chunk at a time and send it before reading the next; budget counts source bytes
+PumpResult pumpCompressed(int socket, FileTransfer& transfer, off_t stop) {
+    static thread_local vector<char> buffer(TRANSFER_CHUNK_SIZE);
+    z_stream* stream = transfer.deflater.get();
+    if (!stream) return PumpResult::Failed;
+    
+    while (true) {
+        while (transfer.compressedSent < transfer.compressed.size()) {
+            ssize_t sent = send(socket, transfer.compressed.data() + transfer.compressedSent,
+                                transfer.compressed.size() - transfer.compressedSent, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return PumpResult::Blocked;
+            if (sent <= 0) return PumpResult::Failed;
+            transfer.compressedSent += sent;
+        }
+        transfer.compressed.clear();
+        transfer.compressedSent = 0;
+        if (transfer.deflateDone) return PumpResult::Done;
+        if (transfer.offset >= stop && transfer.offset < transfer.end) return PumpResult::Paused;
+        
+        size_t wanted = min<off_t>(TRANSFER_CHUNK_SIZE, stop - transfer.offset); // Never past the shaping grant
+        const char* input = transfer.memory ? transfer.memory + transfer.offset : buffer.data();
+        if (!transfer.memory && wanted > 0) {
+            ssize_t bytesRead = pread(transfer.fd, buffer.data(), wanted, transfer.offset);
+            if (bytesRead < 0 && errno == EINTR) continue;
+            if (bytesRead <= 0) return PumpResult::Failed;
+            wanted = bytesRead;
+        }
+        transfer.offset += wanted;
+        int flush = transfer.offset >= transfer.end ? Z_FINISH : Z_NO_FLUSH;
+        
+        stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input));
+        stream->avail_in = wanted;
+        do {
+            size_t used = transfer.compressed.size();
+            transfer.compressed.resize(used + TRANSFER_CHUNK_SIZE);
+            stream->next_out = reinterpret_cast<Bytef*>(&transfer.compressed[used]);
+            stream->avail_out = TRANSFER_CHUNK_SIZE;
+            int status = deflate(stream, flush);
+            transfer.compressed.resize(used + TRANSFER_CHUNK_SIZE - stream->avail_out);
+            if (status == Z_STREAM_ERROR) return PumpResult::Failed;
+            if (status == Z_STREAM_END) transfer.deflateDone = true;
+        } while (stream->avail_out == 0);
+    }
+}
+
+// Stream the transfer until it completes, the socket would block or budget bytes have gone out
+PumpResult pumpTransfer(int socket, FileTransfer& transfer, off_t budget = numeric_limits<off_t>::max()) {
+    static thread_local vector<char> buffer(TRANSFER_CHUNK_SIZE);
+    off_t stop = transfer.end - transfer.offset > budget ? transfer.offset + budget : transfer.end;
+    if (transfer.method == TransferMethod::Deflate) return pumpCompressed(socket, transfer, stop);
+    
+    while (transfer.offset < stop) {
+        size_t wanted = min<off_t>(TRANSFER_CHUNK_SIZE, stop - transfer.offset);
+        ssize_t sent;
+        if (transfer.method == TransferMethod::Sendfile) {
+            // Straight from the page cache; the kernel advances the offset
+            sent = sendfile(socket, transfer.fd, &transfer.offset, wanted);
+            if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                transfer.method = TransferMethod::Copy;
+                continue;
+            }
+            if (sent == 0) errno = EIO; // File shrank underneath us
+        } else if (transfer.memory) {
+            sent = send(socket, transfer.memory + transfer.offset, wanted, MSG_NOSIGNAL);
+            if (sent > 0) transfer.offset += sent;
+        } else {
+            ssize_t bytesRead = pread(transfer.fd, buffer.data(), wanted, transfer.offset);
+            if (bytesRead <= 0) {
+                if (bytesRead < 0 && errno == EINTR) continue;
+                return PumpResult::Failed;
+            }
+            sent = send(socket, buffer.data(), bytesRead, MSG_NOSIGNAL);
+            if (sent > 0) transfer.offset += sent;
+        }
+        
+        if (sent <= 0) {
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return PumpResult::Blocked;
+            if (sent < 0 && errno == EINTR) continue;
+            return PumpResult::Failed;
+        }
+    }
+    return transfer.offset < transfer.end ? PumpResult::Paused : PumpResult::Done;
+}
+
+// Cross-thread task queue that wakes an epoll loop through an eventfd
+class WakeQueue {
+public:
+    WakeQueue() {
+        fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            perror("eventfd failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    int descriptor() const { return fd; }
+    
+    void post(function<void()> task) {
+        {
+            lock_guard<mutex> guard(tasksMutex);
+            tasks.push_back(move(task));
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    
+    void runPending() {
+        uint64_t count;
+        ssize_t ignored = read(fd, &count, sizeof(count));
+        (void)ignored;
+        
+        vector<function<void()>> batch;
+        {
+            lock_guard<mutex> guard(tasksMutex);
+            batch.swap(tasks);
+        }
+        for (auto& task : batch) task();
+    }
+    
+private:
+    int fd = -1;
+    mutex tasksMutex;
+    vector<function<void()>> tasks;
+};
+
+// Minimal io_uring binding over the raw syscalls: one submission and one completion ring
+class IoUring {
+public:
+    ~IoUring() {
+        if (sqRing) munmap(sqRing, ringBytes);
+        if (sqes) munmap(sqes, sqeBytes);
+        if (bufferRing) munmap(bufferRing, bufferRingBytes);
+        if (fd >= 0) close(fd);
+    }
+    
+    bool init(unsigned int entries) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_COOP_TASKRUN; // Completions are reaped by the owning thread anyway
+        fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0) {
+            memset(&params, 0, sizeof(params));
+            fd = syscall(__NR_io_uring_setup, entries, &params);
+        }
+        if (fd < 0) return false;
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) return false;
+        
+        ringBytes = max<size_t>(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                                params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+        sqRing = mmap(nullptr, ringBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        sqeBytes = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = static_cast<struct io_uring_sqe*>(
+            mmap(nullptr, sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqRing == MAP_FAILED || sqes == MAP_FAILED) {
+            sqRing = sqRing == MAP_FAILED ? nullptr : sqRing;
+            sqes = sqes == MAP_FAILED ? nullptr : sqes;
+            return false;
+        }
+        
+        char* base = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        unsigned* array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+        for (unsigned int i = 0; i < sqEntries; ++i) array[i] = i; // Slot i always holds sqes[i]
+        cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<struct io_uring_cqe*>(base + params.cq_off.cqes);
+        localTail = *sqTail;
+        return true;
+    }
+    
+    int descriptor() const { return fd; }
+    
+    // Next free submission entry, zeroed; flushes the queue to the kernel when it is full
+    struct io_uring_sqe* nextSqe() {
+        while (localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) submit(0);
+        struct io_uring_sqe* sqe = &sqes[localTail & sqMask];
+        memset(sqe, 0, sizeof(*sqe));
+        ++localTail;
+        return sqe;
+    }
+    
+    // Publish queued entries and optionally wait for completions, all in one io_uring_enter()
+    void submit(unsigned int waitFor) {
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        unsigned int pending = localTail - submitted;
+        if (pending == 0 && waitFor == 0) return;
+        
+        int result = syscall(__NR_io_uring_enter, fd, pending, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0,
+                             nullptr, 0);
+        if (result > 0) submitted += result;
+        if (result < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            perror("io_uring_enter failed");
+        }
+    }
+    
+    // Hand every available completion to the handler, which may queue new submissions
+    template <typename Handler>
+    void drain(Handler handler) {
+        unsigned int head = *cqHead;
+        while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe cqe = cqes[head & cqMask];
+            __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+            handler(cqe);
+        }
+    }
+    
+    // Kernel-selected receive buffers (group 0) so idle sessions pin no memory of their own
+    bool registerBufferRing(unsigned int count, size_t bufferSize) {
+        bufferRingBytes = count * sizeof(struct io_uring_buf);
+        bufferRing = static_cast<struct io_uring_buf_ring*>(
+            mmap(nullptr, bufferRingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (bufferRing == MAP_FAILED) {
+            bufferRing = nullptr;
+            return false;
+        }
+        
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(bufferRing);
+        reg.ring_entries = count;
+        reg.bgid = 0;
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+        
+        bufferMask = count - 1;
+        this->bufferSize = bufferSize;
+        buffers.assign(count * bufferSize, 0);
+        for (unsigned int i = 0; i < count; ++i) recycleBuffer(i);
+        return true;
+    }
+    
+    char* buffer(uint16_t id) { return buffers.data() + id * bufferSize; }
+    
+    void recycleBuffer(uint16_t id) {
+        // Index the slots by hand: in C++ the header's flex-array wrapper shifts bufs[] by 8 bytes
+        uint16_t tail = bufferRing->tail;
+        struct io_uring_buf& slot = reinterpret_cast<struct io_uring_buf*>(bufferRing)[tail & bufferMask];
+        slot.addr = reinterpret_cast<uint64_t>(buffer(id));
+        slot.len = bufferSize;
+        slot.bid = id;
+        __atomic_store_n(&bufferRing->tail, static_cast<uint16_t>(tail + 1), __ATOMIC_RELEASE);
+    }
+    
+    // Startup check: every opcode both engines use, plus provided-buffer rings (5.19) and
+    // SEND_ZC as a marker for the 6.0 kernels that added multishot recv
+    static bool supported() {
+        IoUring ring;
+        if (!ring.init(8)) return false;
+        
+        size_t probeBytes = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+        vector<char> storage(probeBytes, 0);
+        struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(storage.data());
+        if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) return false;
+        for (int op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ, IORING_OP_POLL_ADD,
+                       IORING_OP_TIMEOUT, IORING_OP_SEND_ZC}) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+        return ring.registerBufferRing(1, 64);
+    }
+
+private:
+    int fd = -1;
+    void* sqRing = nullptr;
+    size_t ringBytes = 0;
+    struct io_uring_sqe* sqes = nullptr;
+    size_t sqeBytes = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned localTail = 0;  // Entries filled by us
+    unsigned submitted = 0;  // Entries consumed by the kernel
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    struct io_uring_cqe* cqes = nullptr;
+    struct io_uring_buf_ring* bufferRing = nullptr;
+    size_t bufferRingBytes = 0;
+    unsigned bufferMask = 0;
+    size_t bufferSize = 0;
+    vector<char> buffers;
+};
+
+struct PassiveListener {
+    int fd;
+    int port;
+};
+
+// Listening sockets for PASV/EPSV, bound once at startup and recycled between transfers.
+// Data connections land on these fixed ports, so concurrent downloads never consume ephemeral ports.
+class PassivePortPool {
+public:
+    // Listeners inherited from a predecessor are adopted as they are; ports it still has in use
+    // fail to bind and stay out of the pool until the next restart
+    void start(const vector<pair<int, int>>& inherited = {}) {
+        unordered_set<int> adopted;
+        for (const auto& entry : inherited) {
+            listeners.push_back(make_unique<PassiveListener>(PassiveListener{entry.first, entry.second}));
+            freeList.push_back(listeners.back().get());
+            adopted.insert(entry.second);
+        }
+        
+        for (int port = PASV_PORT_MIN; port <= PASV_PORT_MAX; ++port) {
+            if (adopted.count(port)) continue;
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0) break;
+            
+            int opt = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = INADDR_ANY;
+            addr.sin_port = htons(port);
+            if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+                close(fd); // Port taken by something else; skip it
+                continue;
+            }
+            listeners.push_back(make_unique<PassiveListener>(PassiveListener{fd, port}));
+            freeList.push_back(listeners.back().get());
+        }
+        
+        if (listeners.empty()) {
+            perror("No passive ports could be bound");
+            exit(EXIT_FAILURE);
+        }
+        log("Passive port pool ready with " + to_string(listeners.size()) + " ports");
+    }
+    
+    PassiveListener* acquire() {
+        lock_guard<mutex> guard(poolMutex);
+        if (freeList.empty()) return nullptr;
+        PassiveListener* listener = freeList.back();
+        freeList.pop_back();
+        
+        // Drop anything that connected while the port sat idle in the pool
+        int stray;
+        while ((stray = accept4(listener->fd, nullptr, nullptr, SOCK_CLOEXEC)) >= 0) close(stray);
+        return listener;
+    }
+    
+    void release(PassiveListener* listener) {
+        lock_guard<mutex> guard(poolMutex);
+        freeList.push_back(listener);
+    }
+    
+    // Take every idle listener out of circulation for a handover; PASV answers 425 until it settles
+    vector<PassiveListener*> surrender() {
+        lock_guard<mutex> guard(poolMutex);
+        return move(freeList);
+    }
+    
+    // The successor never came up
+    void restore(const vector<PassiveListener*>& surrendered) {
+        lock_guard<mutex> guard(poolMutex);
+        freeList.insert(freeList.end(), surrendered.begin(), surrendered.end());
+    }
+    
+    // The successor owns them now; this process only keeps the ports its own transfers hold
+    void retire(const vector<PassiveListener*>& surrendered) {
+        for (PassiveListener* listener : surrendered) {
+            close(listener->fd);
+            listener->fd = -1;
+        }
+    }
+    
+private:
+    mutex poolMutex;
+    vector<unique_ptr<PassiveListener>> listeners;
+    vector<PassiveListener*> freeList;
+};
+
+PassivePortPool passivePortPool;
+
+// Limits that SIGHUP can change without a restart; the constants above are the defaults
+struct RuntimeLimits {
+    atomic<int> maxClients{MAX_CLIENTS};
+    atomic<unsigned int> sessionTimeout{SESSION_TIMEOUT};
+    atomic<int> maxTransfersPerSession{MAX_TRANSFERS_PER_SESSION};
+    atomic<int64_t> globalRate{GLOBAL_RATE_LIMIT};
+    atomic<int64_t> perIpRate{PER_IP_RATE_LIMIT};
+    atomic<int64_t> perUserRate{PER_USER_RATE_LIMIT};
+    
+    // "key = value" lines; keys that are absent fall back to their defaults
+    void load(const string& path) {
+        int64_t values[6] = {MAX_CLIENTS, SESSION_TIMEOUT, MAX_TRANSFERS_PER_SESSION,
+                             GLOBAL_RATE_LIMIT, PER_IP_RATE_LIMIT, PER_USER_RATE_LIMIT};
+        static const char* const keys[6] = {"max_clients_per_ip", "session_timeout", "max_transfers_per_session",
+                                            "global_rate_limit", "per_ip_rate_limit", "per_user_rate_limit"};
+        ifstream file(path);
+        string line;
+        int lineNumber = 0;
+        while (getline(file, line)) {
+            ++lineNumber;
+            if (line.empty() || line[0] == '#') continue;
+            
+            size_t equals = line.find('=');
+            string key = equals == string::npos ? line : line.substr(0, equals);
+            string value = equals == string::npos ? "" : line.substr(equals + 1);
+            key.erase(remove(key.begin(), key.end(), ' '), key.end());
+            value.erase(remove(value.begin(), value.end(), ' '), value.end());
+            size_t index = find(keys, keys + 6, key) - keys;
+            off_t parsed;
+            if (index == 6 || !parseNumber(value, parsed) || (index < 3 && parsed == 0)) {
+                log("Ignoring invalid line " + to_string(lineNumber) + " in " + path);
+                continue;
+            }
+            values[index] = parsed;
+        }
+        
+        maxClients = static_cast<int>(values[0]);
+        sessionTimeout = static_cast<unsigned int>(values[1]);
+        maxTransfersPerSession = static_cast<int>(values[2]);
+        globalRate = values[3];
+        perIpRate = values[4];
+        perUserRate = values[5];
+        if (file.is_open()) log("Loaded limits from " + path);
+    }
+
+private:
+    static bool parseNumber(const string& text, off_t& value) {
+        if (text.empty() || text.size() > 12 || !all_of(text.begin(), text.end(), ::isdigit)) return false;
+        value = stoll(text);
+        return true;
+    }
+};
+
+RuntimeLimits limits;
+
+// Lock-free token bucket in virtual-scheduling (GCRA) form: a single CAS on the time the bucket drains
+class TokenBucket {
+public:
+    // Safe while transfers draw on the bucket; a reload only changes how fast it refills
+    void configure(int64_t bytesPerSecond, int64_t burstBytes) {
+        rate.store(bytesPerSecond, memory_order_relaxed);
+        toleranceNs.store(bytesPerSecond > 0 ? static_cast<int64_t>(burstBytes * 1e9 / bytesPerSecond) : 0,
+                          memory_order_relaxed);
+    }
+    
+    bool limited() const { return rate.load(memory_order_relaxed) > 0; }
+    
+    // Grant up to wanted bytes; 0 means empty, with waitNs until wanted bytes would fit
+    int64_t take(int64_t wanted, int64_t nowNs, int64_t& waitNs) {
+        int64_t rate = this->rate.load(memory_order_relaxed);
+        int64_t toleranceNs = this->toleranceNs.load(memory_order_relaxed);
+        if (rate <= 0) return wanted; // Limit lifted while the transfer was running
+        int64_t drainsAt = nextFree.load(memory_order_relaxed);
+        while (true) {
+            int64_t base = max(drainsAt, nowNs);
+            int64_t headroomNs = nowNs + toleranceNs - base;
+            int64_t granted = min<int64_t>(wanted, static_cast<int64_t>(max<int64_t>(headroomNs, 0) * 1e-9 * rate));
+            if (granted <= 0) {
+                waitNs = max<int64_t>(cost(wanted, rate) - headroomNs, 1000000);
+                return 0;
+            }
+            if (nextFree.compare_exchange_weak(drainsAt, base + cost(granted, rate), memory_order_relaxed)) {
+                return granted;
+            }
+        }
+    }
+    
+    // Return bytes that were granted but never sent
+    void refund(int64_t bytes) {
+        int64_t rate = this->rate.load(memory_order_relaxed);
+        if (rate > 0 && bytes > 0) nextFree.fetch_sub(cost(bytes, rate), memory_order_relaxed);
+    }
+
+private:
+    atomic<int64_t> rate{0};        // Bytes per second, 0 for unlimited
+    atomic<int64_t> toleranceNs{0}; // Burst expressed as time credit
+    atomic<int64_t> nextFree{0};
+    
+    static int64_t cost(int64_t bytes, int64_t rate) { return static_cast<int64_t>(bytes * 1e9 / rate); }
+};
+
+// Per-IP session counts packed as (IPv4 << 32 | sessions) in an open-addressed table, so admission
+// is a probe and a CAS with no lock. Each slot also carries that address's bandwidth bucket.
+class AdmissionTable {
+public:
+    void configureRate(int64_t bytesPerSecond) {
+        for (TokenBucket& bucket : buckets) bucket.configure(bytesPerSecond, SHAPING_BURST);
+    }
+    
+    // Charge one session to the address (network byte order); returns its slot, or -1 at the per-address
+    // limit or when the table is full. Loopback clients (local tools such as the load generator) are
+    // still counted and shaped but not capped.
+    int acquire(uint32_t ip) {
+        bool loopback = (ntohl(ip) >> 24) == 127;
+        uint64_t maxClients = loopback ? 0xffffffffu : limits.maxClients.load(memory_order_relaxed);
+        while (true) {
+            size_t home = (ip * 2654435761u) & (ADMISSION_TABLE_SIZE - 1);
+            int reusable = -1;
+            bool retry = false;
+            for (size_t probe = 0; probe < ADMISSION_TABLE_SIZE && !retry; ++probe) {
+                size_t index = (home + probe) & (ADMISSION_TABLE_SIZE - 1);
+                uint64_t word = slots[index].load(memory_order_acquire);
+                if (word == 0) {
+                    if (reusable < 0) reusable = index;
+                    break; // End of the probe chain: the address has no slot yet
+                }
+                if ((word >> 32) == ip) {
+                    if ((word & 0xffffffff) >= maxClients) return -1;
+                    if (slots[index].compare_exchange_weak(word, word + 1, memory_order_acq_rel)) return index;
+                    retry = true;
+                } else if ((word & 0xffffffff) == 0 && reusable < 0) {
+                    reusable = index; // Address with no sessions left; the slot can change hands
+                }
+            }
+            if (retry) continue;
+            if (reusable < 0) return -1;
+            
+            uint64_t word = slots[reusable].load(memory_order_acquire);
+            if ((word & 0xffffffff) == 0 &&
+                slots[reusable].compare_exchange_strong(word, (uint64_t(ip) << 32) | 1, memory_order_acq_rel)) {
+                // Another thread may have claimed a different slot for the same address meanwhile.
+                // The entry earliest in the probe chain wins; a later one is handed back and the
+                // session is charged to the winner on the next pass.
+                if (!claimedEarlier(ip, home, reusable)) return reusable;
+                release(reusable);
+            }
+        }
+    }
+    
+    void release(int slot) {
+        slots[slot].fetch_sub(1, memory_order_acq_rel);
+    }
+    
+    TokenBucket* bucket(int slot) { return &buckets[slot]; }
+
+private:
+    atomic<uint64_t> slots[ADMISSION_TABLE_SIZE] = {};
+    TokenBucket buckets[ADMISSION_TABLE_SIZE];
+    
+    // Whether the address also owns a slot before slot in its probe chain. Slots are never emptied
+    // again, so the chain up to slot is fixed.
+    bool claimedEarlier(uint32_t ip, size_t home, size_t slot) const {
+        for (size_t index = home; index != slot; index = (index + 1) & (ADMISSION_TABLE_SIZE - 1)) {
+            if ((slots[index].load(memory_order_acquire) >> 32) == ip) return true;
+        }
+        return false;
+    }
+};
+
+AdmissionTable admissionTable;
+
+// Global and per-user buckets; per-IP buckets live in the admission table
+class BandwidthLimits {
+public:
+    TokenBucket global;
+    
+    void configure(int64_t globalRate, int64_t perUserRate) {
+        global.configure(globalRate, SHAPING_BURST);
+        lock_guard<mutex> guard(usersMutex);
+        userRate = perUserRate;
+        for (auto& entry : users) entry.second->configure(userRate, SHAPING_BURST);
+    }
+    
+    // Called once per login, never on the transfer path
+    TokenBucket* userBucket(const string& username) {
+        lock_guard<mutex> guard(usersMutex);
+        unique_ptr<TokenBucket>& bucket = users[username];
+        if (!bucket) {
+            bucket = make_unique<TokenBucket>();
+            bucket->configure(userRate, SHAPING_BURST);
+        }
+        return bucket.get();
+    }
+
+private:
+    mutex usersMutex;
+    int64_t userRate = 0;
+    unordered_map<string, unique_ptr<TokenBucket>> users; // One per account, so bounded by the credentials file
+};
+
+BandwidthLimits bandwidthLimits;
+
+// Push the current limits into the buckets; running transfers pick up the new rates on their next grant
+void applyLimits() {
+    admissionTable.configureRate(limits.perIpRate.load());
+    bandwidthLimits.configure(limits.globalRate.load(), limits.perUserRate.load());
+}
+
+// The buckets one RETR draws from; a grant is the smallest any level allows
+struct TransferShaper {
+    TokenBucket* buckets[3] = {};
+    
+    bool active() const { return buckets[0] || buckets[1] || buckets[2]; }
+    
+    int64_t take(int64_t wanted, int64_t& waitNs) {
+        int64_t nowNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t granted = wanted;
+        for (int level = 0; level < 3 && granted > 0; ++level) {
+            if (!buckets[level]) continue;
+            int64_t allowed = buckets[level]->take(granted, nowNs, waitNs);
+            for (int above = 0; above < level; ++above) {
+                if (buckets[above]) buckets[above]->refund(granted - allowed);
+            }
+            granted = allowed;
+        }
+        return granted;
+    }
+    
+    void refund(int64_t bytes) {
+        for (TokenBucket* bucket : buckets) {
+            if (bucket) bucket->refund(bytes);
+        }
+    }
+};
+
+// A LIST or RETR waiting for, then streaming over, its passive data connection
+struct DataTransfer {
+    PassiveListener* listener = nullptr;
+    int socket = -1;
+    FileTransfer transfer;
+    string clientIP;
+    string username;
+    string completionReply; // Sent on the control channel once the data is delivered
+    EventLoop* loop;
+    int controlSocket;
+    uint64_t sessionId;
+    time_t lastProgress;
+    int inflight = 0;           // io_uring operations not yet completed
+    bool chainFailed = false;
+    vector<char> chainBuffer;   // Read targets for file-backed io_uring chains
+    TransferShaper shaper;      // Empty for LIST and when no rate limit applies
+    int64_t resumeAt = 0;       // Steady-clock ns when a throttled transfer may continue, 0 if not throttled
+};
+
+bool uringEngine = false; // Chosen once in main() before any loop or worker starts
+
+void notifyTransferDone(const DataTransfer& job, const string& reply);
+
+// Moves data-channel bytes on its own epoll set so control sessions never wait on a transfer.
+// With io_uring the bytes move through linked read/send chains and the ring fd joins the epoll set.
+class DataWorker {
+public:
+    DataWorker() {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            perror("epoll_create1 failed");
+            exit(EXIT_FAILURE);
+        }
+        
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &wakeQueue;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeQueue.descriptor(), &ev) < 0) {
+            perror("epoll_ctl failed");
+            exit(EXIT_FAILURE);
+        }
+        
+        useUring = uringEngine && ring.init(URING_ENTRIES);
+        ev.data.ptr = &ring;
+        if (useUring && epoll_ctl(epollFd, EPOLL_CTL_ADD, ring.descriptor(), &ev) < 0) {
+            perror("epoll_ctl failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    void submit(unique_ptr<DataTransfer> job) {
+        DataTransfer* raw = job.release();
+        wakeQueue.post([this, raw] { adopt(unique_ptr<DataTransfer>(raw)); });
+    }
+    
+    void run() {
+        vector<struct epoll_event> events(MAX_EPOLL_EVENTS);
+        time_t lastSweep = coarseNow();
+        
+        while (true) {
+            int ready = epoll_wait(epollFd, events.data(), events.size(), nextThrottleTimeout());
+            if (ready < 0 && errno != EINTR) {
+                perror("epoll_wait failed");
+                continue;
+            }
+            
+            for (int i = 0; i < ready; ++i) {
+                if (events[i].data.ptr == &wakeQueue) {
+                    wakeQueue.runPending();
+                    continue;
+                }
+                if (events[i].data.ptr == &ring) {
+                    ring.drain([this](const struct io_uring_cqe& cqe) { completeChainStep(cqe); });
+                    ring.submit(0);
+                    continue;
+                }
+                
+                DataTransfer* job = static_cast<DataTransfer*>(events[i].data.ptr);
+                if (!jobs.count(job)) continue; // Finished earlier in this batch
+                if (job->socket < 0) {
+                    acceptDataConnection(*job);
+                } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    finish(*job, false, "426 Connection closed; transfer aborted\r\n");
+                } else {
+                    advance(*job);
+                }
+            }
+            
+            // Only once the batch is done: resuming can finish jobs that later events still point at
+            resumeThrottled();
+            
+            time_t now = coarseNow(); // Same clock as lastProgress
+            if (now != lastSweep) {
+                expireStalledTransfers(now);
+                lastSweep = now;
+            }
+            retired.clear();
+        }
+    }
+    
+private:
+    int epollFd = -1;
+    WakeQueue wakeQueue;
+    IoUring ring;
+    bool useUring = false;
+    unordered_map<DataTransfer*, unique_ptr<DataTransfer>> jobs;
+    vector<unique_ptr<DataTransfer>> retired; // Finished this batch; freed once no event can refer to them
+    set<pair<int64_t, DataTransfer*>> throttled; // Ordered by resume time
+    
+    static int64_t steadyNowNs() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    // Park a transfer whose buckets are empty; the run loop wakes up in time to resume it
+    void throttle(DataTransfer& job, int64_t waitNs) {
+        job.resumeAt = steadyNowNs() + waitNs;
+        throttled.insert({job.resumeAt, &job});
+    }
+    
+    int nextThrottleTimeout() const {
+        if (throttled.empty()) return 1000;
+        int64_t waitMs = (throttled.begin()->first - steadyNowNs() + 999999) / 1000000;
+        return static_cast<int>(max<int64_t>(0, min<int64_t>(waitMs, 1000)));
+    }
+    
+    // Compressed transfers produce their bytes in user space, so they always use the epoll pump
+    bool ringDriven(const DataTransfer& job) const {
+        return useUring && job.transfer.method != TransferMethod::Deflate;
+    }
+    
+    void resumeThrottled() {
+        int64_t now = steadyNowNs();
+        while (!throttled.empty() && throttled.begin()->first <= now) {
+            DataTransfer& job = *throttled.begin()->second;
+            throttled.erase(throttled.begin());
+            job.resumeAt = 0;
+            if (ringDriven(job)) {
+                submitChain(job);
+            } else {
+                advance(job);
+            }
+        }
+    }
+    
+    void adopt(unique_ptr<DataTransfer> job) {
+        mapFileTransfer(job->transfer);
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = job.get();
+        job->lastProgress = coarseNow();
+        DataTransfer* raw = job.get();
+        jobs[raw] = move(job);
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, raw->listener->fd, &ev) < 0) {
+            finish(*raw, false, "425 Can't open data connection\r\n");
+        }
+    }
+    
+    void acceptDataConnection(DataTransfer& job) {
+        while (true) {
+            struct sockaddr_in peerAddr;
+            socklen_t peerAddrLen = sizeof(peerAddr);
+            int dataSocket = accept4(job.listener->fd, (struct sockaddr *)&peerAddr, &peerAddrLen,
+                                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (dataSocket < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                finish(job, false, "425 Can't open data connection\r\n");
+                return;
+            }
+            
+            // Only the host that owns the control connection may claim the data channel
+            string peerIP = inet_ntoa(peerAddr.sin_addr);
+            if (peerIP != job.clientIP) {
+                log("Rejected data connection from " + peerIP, job.clientIP, job.username);
+                close(dataSocket);
+                continue;
+            }
+            
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, job.listener->fd, nullptr);
+            passivePortPool.release(job.listener);
+            job.listener = nullptr;
+            job.socket = dataSocket;
+            if (ringDriven(job)) {
+                submitChain(job);
+                return;
+            }
+            
+            struct epoll_event ev = {};
+            ev.events = EPOLLOUT | EPOLLET;
+            ev.data.ptr = &job;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, dataSocket, &ev) < 0) {
+                finish(job, false, "425 Can't open data connection\r\n");
+                return;
+            }
+            advance(job);
+            return;
+        }
+    }
+    
+    void advance(DataTransfer& job) {
+        if (job.resumeAt) return; // Throttled; resumeThrottled() picks it up
+        
+        PumpResult result;
+        do {
+            if (!job.shaper.active()) {
+                result = pumpTransfer(job.socket, job.transfer);
+                break;
+            }
+            int64_t waitNs;
+            int64_t granted = job.shaper.take(SHAPING_QUANTUM, waitNs);
+            if (granted == 0) {
+                throttle(job, waitNs);
+                return;
+            }
+            off_t before = job.transfer.offset;
+            result = pumpTransfer(job.socket, job.transfer, granted);
+            job.shaper.refund(granted - (job.transfer.offset - before));
+        } while (result == PumpResult::Paused);
+        job.lastProgress = coarseNow();
+        if (result == PumpResult::Done) {
+            finish(job, true, job.completionReply);
+        } else if (result == PumpResult::Failed) {
+            finish(job, false, "426 Connection closed; transfer aborted\r\n");
+        }
+    }
+    
+    // Queue the next stretch of the transfer as one linked chain: send-only for in-memory payloads,
+    // read+send pairs through the job's buffer for files. One io_uring_enter() covers the whole chain.
+    void submitChain(DataTransfer& job) {
+        FileTransfer& transfer = job.transfer;
+        if (transfer.offset >= transfer.end) {
+            finish(job, true, job.completionReply);
+            return;
+        }
+        
+        off_t position = transfer.offset;
+        off_t stop = transfer.end;
+        if (job.shaper.active()) {
+            int64_t waitNs;
+            int64_t granted = job.shaper.take(URING_SEGMENT_SIZE * URING_CHAIN_SEGMENTS, waitNs);
+            if (granted == 0) {
+                throttle(job, waitNs);
+                return;
+            }
+            stop = min<off_t>(stop, position + granted);
+        }
+        
+        uint64_t tag = reinterpret_cast<uint64_t>(&job);
+        if (transfer.memory) {
+            size_t length = min<off_t>(URING_SEGMENT_SIZE * URING_CHAIN_SEGMENTS, stop - position);
+            struct io_uring_sqe* send = ring.nextSqe();
+            send->opcode = IORING_OP_SEND;
+            send->fd = job.socket;
+            send->addr = reinterpret_cast<uint64_t>(transfer.memory + position);
+            send->len = length;
+            send->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+            send->user_data = tag | 1; // Low bit marks sends; jobs are at least 8-byte aligned
+            job.inflight++;
+        } else {
+            transfer.method = TransferMethod::Uring;
+            if (job.chainBuffer.empty()) job.chainBuffer.resize(URING_SEGMENT_SIZE * URING_CHAIN_SEGMENTS);
+            for (int i = 0; i < URING_CHAIN_SEGMENTS && position < stop; ++i) {
+                size_t length = min<off_t>(URING_SEGMENT_SIZE, stop - position);
+                char* target = job.chainBuffer.data() + i * URING_SEGMENT_SIZE;
+                
+                struct io_uring_sqe* read = ring.nextSqe();
+                read->opcode = IORING_OP_READ;
+                read->fd = transfer.fd;
+                read->addr = reinterpret_cast<uint64_t>(target);
+                read->len = length;
+                read->off = position;
+                read->flags = IOSQE_IO_LINK; // A short read cancels the send behind it
+                read->user_data = tag;
+                
+                position += length;
+                struct io_uring_sqe* send = ring.nextSqe();
+                send->opcode = IORING_OP_SEND;
+                send->fd = job.socket;
+                send->addr = reinterpret_cast<uint64_t>(target);
+                send->len = length;
+                send->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+                send->flags = (i + 1 < URING_CHAIN_SEGMENTS && position < stop) ? IOSQE_IO_LINK : 0;
+                send->user_data = tag | 1;
+                job.inflight += 2;
+            }
+        }
+        ring.submit(0);
+    }
+    
+    // Chains complete in order; once the last step is in, either continue, finish or fail
+    void completeChainStep(const struct io_uring_cqe& cqe) {
+        DataTransfer& job = *reinterpret_cast<DataTransfer*>(cqe.user_data & ~uint64_t(1));
+        bool isSend = cqe.user_data & 1;
+        job.inflight--;
+        job.lastProgress = coarseNow();
+        
+        if (isSend && cqe.res > 0) {
+            job.transfer.offset += cqe.res;
+        } else if (cqe.res < 0 && cqe.res != -ECANCELED) {
+            job.chainFailed = true;
+        } else if (!isSend && cqe.res == 0) {
+            job.chainFailed = true; // File shrank underneath us
+        }
+        
+        if (job.inflight > 0) return;
+        if (job.chainFailed) {
+            finish(job, false, "426 Connection closed; transfer aborted\r\n");
+        } else {
+            submitChain(job); // Also restarts after a short read cancelled part of the chain
+        }
+    }
+    
+    void finish(DataTransfer& job, bool completed, const string& reply) {
+        if (job.resumeAt) throttled.erase({job.resumeAt, &job});
+        if (job.listener) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, job.listener->fd, nullptr);
+            passivePortPool.release(job.listener);
+        }
+        if (job.socket >= 0) close(job.socket); // Also removes it from the epoll set
+        log(finishTransfer(job.transfer, completed), job.clientIP, job.username);
+        notifyTransferDone(job, reply);
+        metrics.activeTransfers.fetch_sub(1, memory_order_relaxed);
+        auto entry = jobs.find(&job);
+        retired.push_back(move(entry->second));
+        jobs.erase(entry);
+    }
+    
+    void expireStalledTransfers(time_t now) {
+        vector<DataTransfer*> expired;
+        for (auto& entry : jobs) {
+            DataTransfer* job = entry.first;
+            unsigned int limit = job->socket < 0 ? DATA_CONNECT_TIMEOUT : limits.sessionTimeout.load(memory_order_relaxed);
+            if (difftime(now, job->lastProgress) > limit) expired.push_back(job);
+        }
+        for (DataTransfer* job : expired) {
+            if (job->inflight > 0) {
+                // The ring still references the job; failing its sends lets the chain finish it
+                shutdown(job->socket, SHUT_RDWR);
+                continue;
+            }
+            finish(*job, false, job->socket < 0 ? "425 Can't open data connection\r\n"
+                                                : "426 Connection closed; transfer aborted\r\n");
+        }
+    }
+};
+
+// Fixed pool of data workers; transfers are spread round-robin
+class DataWorkerPool {
+public:
+    void start(unsigned int count) {
+        for (unsigned int i = 0; i < count; ++i) {
+            workers.push_back(make_unique<DataWorker>());
+            thread(&DataWorker::run, workers.back().get()).detach();
+        }
+    }
+    
+    void submit(unique_ptr<DataTransfer> job) {
+        workers[next.fetch_add(1, memory_order_relaxed) % workers.size()]->submit(move(job));
+    }
+    
+private:
+    vector<unique_ptr<DataWorker>> workers;
+    atomic<unsigned int> next{0};
+};
+
+DataWorkerPool dataWorkers;
+
+// Hand a prepared transfer to the worker pool over the session's passive listener
+void submitDataTransfer(ClientSession& session, unique_ptr<DataTransfer> job, const string& completionReply) {
+    job->listener = session.passive;
+    job->clientIP = session.clientIP;
+    job->username = session.username;
+    job->completionReply = completionReply;
+    job->loop = session.loop;
+    job->controlSocket = session.socket;
+    job->sessionId = session.id;
+    session.passive = nullptr;
+    ++session.activeTransfers;
+    metrics.activeTransfers.fetch_add(1, memory_order_relaxed);
+    dataWorkers.submit(move(job));
+}
+
+// RETR draws on every enabled rate limit; LIST and control replies are never shaped
+TransferShaper shaperFor(const ClientSession& session) {
+    TransferShaper shaper;
+    if (bandwidthLimits.global.limited()) shaper.buckets[0] = &bandwidthLimits.global;
+    if (limits.perIpRate.load(memory_order_relaxed) > 0) shaper.buckets[1] = admissionTable.bucket(session.admissionSlot);
+    if (session.userBucket && session.userBucket->limited()) shaper.buckets[2] = session.userBucket;
+    return shaper;
+}
+
+// Parse a non-negative byte offset from a REST or RANG argument
+bool parseOffset(const string& text, off_t& value) {
+    if (text.empty() || text.size() > 18 || !all_of(text.begin(), text.end(), ::isdigit)) return false;
+    value = stoll(text);
+    return true;
+}
+
+// Execute a single control command; returns its ALLOWED_COMMANDS index for the metrics
+size_t handleCommand(ClientSession& session, const string& command) {
+    // Basic command validation
+    if (command.length() > MAX_COMMAND_LENGTH) {
+        sendResponse(session, "500 Command too long\r\n");
+        return ALLOWED_COMMANDS.size();
+    }
+    
+    string cmd = command.substr(0, command.find(' '));
+    transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    
+    // Check if command is allowed
+    size_t commandIndex = find(ALLOWED_COMMANDS.begin(), ALLOWED_COMMANDS.end(), cmd) - ALLOWED_COMMANDS.begin();
+    if (commandIndex == ALLOWED_COMMANDS.size()) {
+        sendResponse(session, "500 Unknown command\r\n");
+        return commandIndex;
+    }
+    
+    if (cmd == "QUIT") {
+        sendResponse(session, "221 Goodbye\r\n");
+        session.closing = true;
+    }
+    else if (cmd == "NOOP") {
+        sendResponse(session, "200 NOOP ok\r\n");
+    }
+    else if (cmd == "USER") {
+        if (command.length() > 5) {
+            session.username = command.substr(5);
+            sendResponse(session, "331 Password required\r\n");
+        } else {
+            sendResponse(session, "501 Syntax error in parameters\r\n");
+        }
+    }
+    else if (cmd == "PASS") {
+        if (session.username.empty()) {
+            sendResponse(session, "503 Login with USER first\r\n");
+        } else if (command.length() > 5) {
+            // Commands after PASS wait in the framer until the auth worker answers
+            LoginRequest request{session.loop, session.socket, session.id, session.username, command.substr(5)};
+            if (authWorkers.submit(move(request))) {
+                session.authPending = true;
+            } else {
+                sendResponse(session, "421 Too many logins in progress, try again later\r\n");
+                log("Login refused: authentication queue full", &session);
+                session.closing = true;
+            }
+        } else {
+            sendResponse(session, "501 Syntax error in parameters\r\n");
+        }
+    }
+    else if (!session.authenticated) {
+        sendResponse(session, "530 Not logged in\r\n");
+    }
+    else if (cmd == "TYPE") {
+        // Transfers are always binary; ASCII is accepted for client compatibility
+        string type = command.length() > 5 ? command.substr(5) : "";
+        if (type == "I" || type == "A") {
+            sendResponse(session, "200 Type set to " + type + "\r\n");
+        } else {
+            sendResponse(session, "504 Command not implemented for that parameter\r\n");
+        }
+    }
+    else if (cmd == "MODE") {
+        // Stream mode, or deflate-compressed stream mode (MODE Z)
+        string mode = command.length() > 5 ? command.substr(5) : "";
+        transform(mode.begin(), mode.end(), mode.begin(), ::toupper);
+        if (mode == "S" || mode == "Z") {
+            session.compressTransfers = mode == "Z";
+            sendResponse(session, "200 Mode set to " + mode + "\r\n");
+        } else {
+            sendResponse(session, "504 Command not implemented for that parameter\r\n");
+        }
+    }
+    else if (cmd == "PASV" || cmd == "EPSV") {
+        // A new request replaces a reservation that was never used
+        if (session.passive) passivePortPool.release(session.passive);
+        session.passive = passivePortPool.acquire();
+        
+        struct sockaddr_in localAddr;
+        socklen_t localAddrLen = sizeof(localAddr);
+        if (!session.passive) {
+            sendResponse(session, "425 No passive ports available\r\n");
+        } else if (getsockname(session.socket, (struct sockaddr *)&localAddr, &localAddrLen) < 0) {
+            passivePortPool.release(session.passive);
+            session.passive = nullptr;
+            sendResponse(session, "425 Can't open passive connection\r\n");
+        } else if (cmd == "EPSV") {
+            sendResponse(session, "229 Entering Extended Passive Mode (|||" + to_string(session.passive->port) + "|)\r\n");
+        } else {
+            const unsigned char* ip = reinterpret_cast<const unsigned char*>(&localAddr.sin_addr.s_addr);
+            stringstream reply;
+            reply << "227 Entering Passive Mode (" << int(ip[0]) << "," << int(ip[1]) << "," << int(ip[2]) << ","
+                  << int(ip[3]) << "," << (session.passive->port >> 8) << "," << (session.passive->port & 0xff) << ")\r\n";
+            sendResponse(session, reply.str());
+        }
+    }
+    else if (cmd == "FEAT") {
+        sendResponse(session, "211-Features:\r\n EPSV\r\n PASV\r\n SIZE\r\n REST STREAM\r\n RANG STREAM\r\n MODE Z\r\n211 End\r\n");
+    }
+    else if (cmd == "REST") {
+        off_t offset;
+        if (command.length() > 5 && parseOffset(command.substr(5), offset)) {
+            session.restartOffset = offset;
+            session.rangeEnd = -1;
+            sendResponse(session, "350 Restarting at " + to_string(offset) + ". Send RETR to resume\r\n");
+        } else {
+            sendResponse(session, "501 Syntax error in parameters\r\n");
+        }
+    }
+    else if (cmd == "RANG") {
+        // draft-bryan-ftp-range: RANG <start> <end>, inclusive; "RANG 1 0" resets
+        size_t split = command.find(' ', 5);
+        off_t start, end;
+        if (command.length() <= 5 || split == string::npos ||
+            !parseOffset(command.substr(5, split - 5), start) || !parseOffset(command.substr(split + 1), end)) {
+            sendResponse(session, "501 Syntax error in parameters\r\n");
+        } else if (start == 1 && end == 0) {
+            session.restartOffset = 0;
+            session.rangeEnd = -1;
+            sendResponse(session, "350 Restarting at 0. End marker reset\r\n");
+        } else if (end < start) {
+            sendResponse(session, "501 End of range precedes start\r\n");
+        } else {
+            session.restartOffset = start;
+            session.rangeEnd = end;
+            sendResponse(session, "350 Restarting at " + to_string(start) + ". Ending byte at " + to_string(end) + "\r\n");
+        }
+    }
+    else if (cmd == "STAT") {
+        sendResponse(session, "211-Secure FTP Server status\r\n"
+                              " Connected from " + session.clientIP + "\r\n"
+                              " Logged in as " + session.username + "\r\n"
+                              " " + to_string(session.activeTransfers) + " data transfers in progress\r\n"
+                              " File cache: " + fileCache.stats() + "\r\n"
+                              " MODE Z: " + sidecarCache.stats() + "\r\n"
+                              " Server: " + to_string(metrics.activeSessions.load()) + " active sessions, " +
+                              to_string(metrics.total(&MetricsShard::bytesSent)) + " bytes sent, " +
+                              to_string(metrics.total(&MetricsShard::authFailures)) + " failed logins\r\n"
+                              "211 End of status\r\n");
+    }
+    else if (cmd == "LIST" || cmd == "NLST") { // The listing is names only, so both are identical
+        if (!session.passive) {
+            sendResponse(session, "425 Use PASV or EPSV first\r\n");
+        } else {
+            auto job = make_unique<DataTransfer>();
+            startBufferTransfer(job->transfer, directoryIndex.snapshot()->listing);
+            if (session.compressTransfers) startCompression(job->transfer);
+            sendResponse(session, "150 Here comes the directory listing\r\n");
+            submitDataTransfer(session, move(job), "226 Directory send OK\r\n");
+        }
+    }
+    else if (cmd == "RETR") {
+        if (command.length() > 5) {
+            string filename = command.substr(5);
+            try {
+                string filepath = getSecurePath(filename);
+                long fileSize = getSecureFileSize(filename);
+                
+                if (fileSize == -1) {
+                    sendResponse(session, "550 File not found or access denied\r\n");
+                } else if (fileSize == -2) {
+                    sendResponse(session, "552 Requested file size exceeds limit\r\n");
+                } else if (!session.passive) {
+                    sendResponse(session, "425 Use PASV or EPSV first\r\n");
+                } else if (session.activeTransfers >= limits.maxTransfersPerSession.load(memory_order_relaxed)) {
+                    sendResponse(session, "425 Too many transfers in progress\r\n");
+                } else {
+                    // REST and RANG apply to this RETR only
+                    off_t start = session.restartOffset;
+                    off_t rangeEnd = session.rangeEnd;
+                    session.restartOffset = 0;
+                    session.rangeEnd = -1;
+                    
+                    // Hot files come straight from the cache; everything else is opened per request
+                    shared_ptr<const CachedFile> cached = fileCache.acquire(filename);
+                    int fd = -1;
+                    off_t fileSize = -1;
+                    if (cached) {
+                        fileSize = cached->size;
+                    } else {
+                        fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+                        struct stat stat_buf;
+                        if (fd >= 0 && fstat(fd, &stat_buf) == 0) {
+                            // The index may lag a rewrite by a few ms; the open file is authoritative
+                            fileSize = min<off_t>(stat_buf.st_size, MAX_FILE_SIZE);
+                        } else if (fd >= 0) {
+                            close(fd);
+                        }
+                    }
+                    
+                    off_t end = rangeEnd >= 0 ? min<off_t>(rangeEnd + 1, fileSize) : fileSize;
+                    if (fileSize < 0) {
+                        sendResponse(session, "550 Could not open file\r\n");
+                    } else if (start > fileSize || (rangeEnd >= 0 && start >= fileSize)) {
+                        if (fd >= 0) close(fd);
+                        sendResponse(session, "554 Requested range not satisfiable\r\n");
+                    } else {
+                        sendResponse(session, "150 Opening BINARY mode data connection for " + filename +
+                                              " (" + to_string(end - start) + " bytes)\r\n");
+                        auto job = make_unique<DataTransfer>();
+                        job->shaper = shaperFor(session);
+                        // Whole-file MODE Z downloads send a prebuilt sidecar when one is ready
+                        off_t compressedSize = 0;
+                        int sidecarFd = session.compressTransfers && start == 0 && end == fileSize
+                                        ? sidecarCache.open(filename, compressedSize) : -1;
+                        if (sidecarFd >= 0) {
+                            if (fd >= 0) close(fd);
+                            cached.reset();
+                            startFileTransfer(job->transfer, sidecarFd, compressedSize, 0, compressedSize);
+                        } else if (cached) {
+                            startCachedTransfer(job->transfer, move(cached), start, end);
+                        } else {
+                            startFileTransfer(job->transfer, fd, fileSize, start, end);
+                        }
+                        if (session.compressTransfers && sidecarFd < 0) startCompression(job->transfer);
+                        submitDataTransfer(session, move(job), "226 Transfer complete\r\n");
+                    }
+                }
+            } catch (const exception& e) {
+                sendResponse(session, "550 Access denied\r\n");
+                log(string("File access denied: ") + e.what(), &session);
+            }
+        } else {
+            sendResponse(session, "501 Syntax error in parameters\r\n");
+        }
+    }
+    else if (cmd == "SIZE") {
+        if (command.length() > 5) {
+            string filename = command.substr(5);
+            try {
+                long size = getSecureFileSize(filename);
+                if (size >= 0) {
+                    sendResponse(session, "213 " + to_string(size) + "\r\n");
+                } else if (size == -2) {
+                    sendResponse(session, "552 File too large\r\n");
+                } else {
+                    sendResponse(session, "550 File not found or access denied\r\n");
+                }
+            } catch (...) {
+                sendResponse(session, "550 Access denied\r\n");
+            }
+        } else {
+            sendResponse(session, "501 Syntax error in parameters\r\n");
+        }
+    }
+    return commandIndex;
+}
+
+// Create a non-blocking listening socket; SO_REUSEPORT lets every event loop bind its own
+int createListenSocket() {
+    int listenSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenSocket < 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    int opt = 1;
+    if (setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("Setsockopt failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+    serverAddr.sin_port = htons(FTP_PORT);
+    
+    if (bind(listenSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
+        perror("Bind failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    if (listen(listenSocket, LISTEN_BACKLOG) < 0) {
+        perror("Listen failed");
+        exit(EXIT_FAILURE);
+    }
+    return listenSocket;
+}
+
+// Edge-triggered epoll reactor; each instance owns a listener and its sessions
+class EventLoop {
+public:
+    // A listener inherited from a predecessor keeps its queued connections
+    explicit EventLoop(int inheritedListener = -1) {
+        listenSocket = inheritedListener >= 0 ? inheritedListener : createListenSocket();
+        useUring = uringEngine && ring.init(URING_ENTRIES) &&
+                   ring.registerBufferRing(URING_RECV_BUFFERS, URING_RECV_BUFFER_SIZE);
+        if (useUring) return;
+        
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            perror("epoll_create1 failed");
+            exit(EXIT_FAILURE);
+        }
+        
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = nullptr; // nullptr marks the listener
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSocket, &ev) < 0) {
+            perror("epoll_ctl failed");
+            exit(EXIT_FAILURE);
+        }
+        
+        ev.events = EPOLLIN;
+        ev.data.ptr = &wakeQueue;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeQueue.descriptor(), &ev) < 0) {
+            perror("epoll_ctl failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    void run() {
+        if (useUring) {
+            runUring();
+            return;
+        }
+        
+        vector<struct epoll_event> events(MAX_EPOLL_EVENTS);
+        while (true) {
+            int ready = epoll_wait(epollFd, events.data(), events.size(), 1000);
+            if (ready < 0 && errno != EINTR) {
+                perror("epoll_wait failed");
+                continue;
+            }
+            
+            for (int i = 0; i < ready; ++i) {
+                if (events[i].data.ptr == &wakeQueue) {
+                    wakeQueue.runPending();
+                    continue;
+                }
+                
+                ClientSession* session = static_cast<ClientSession*>(events[i].data.ptr);
+                if (!session) {
+                    acceptClients();
+                    continue;
+                }
+                if (session->socket < 0) continue; // Closed earlier in this batch
+                
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    session->closing = true;
+                } else {
+                    if (events[i].events & EPOLLIN) readCommands(*session);
+                    flushOutput(*session);
+                }
+                if (session->closing) closeSession(*session);
+            }
+            
+            expireIdleSessions(coarseNow()); // No-op until the wheel's next one-second tick
+            retiredSessions.clear();
+        }
+    }
+    
+    // Safe to call from any thread
+    void post(function<void()> task) { wakeQueue.post(move(task)); }
+    
+    // Runs on this loop once an auth worker has checked the session's password
+    void completeLogin(int controlSocket, uint64_t sessionId, bool accepted) {
+        auto it = sessions.find(controlSocket);
+        if (it == sessions.end() || it->second->id != sessionId) return;
+        
+        ClientSession& session = *it->second;
+        session.authPending = false;
+        if (accepted) {
+            session.authenticated = true;
+            session.userBucket = bandwidthLimits.userBucket(session.username); // Unlimited unless configured
+            sendResponse(session, "230 Login successful\r\n");
+            log("User authenticated", &session);
+        } else {
+            sendResponse(session, "530 Login incorrect\r\n");
+            metrics.recordAuthFailure();
+            log("Failed authentication attempt", &session);
+        }
+        
+        dispatchCommands(session); // Commands pipelined behind PASS
+        closeIfDrained(session);
+        flushOutput(session);
+        armWritePoll(session);
+        if (session.closing) closeSession(session);
+    }
+    
+    // Runs on this loop once a data worker has finished with the session's transfer
+    void completeTransfer(int controlSocket, uint64_t sessionId, const string& reply) {
+        auto it = sessions.find(controlSocket);
+        if (it == sessions.end() || it->second->id != sessionId) return; // Control connection already gone
+        
+        ClientSession& session = *it->second;
+        --session.activeTransfers;
+        sendResponse(session, reply);
+        closeIfDrained(session);
+        flushOutput(session);
+        armWritePoll(session);
+        if (session.closing) closeSession(session);
+    }
+    
+    // Only read by the handover thread before it asks this loop to drain
+    int listener() const { return listenSocket; }
+    
+    // Runs on this loop once a successor holds the listener: stop accepting and let sessions finish
+    void beginDrain() {
+        if (useUring) {
+            struct io_uring_sqe* sqe = ring.nextSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = userData(TagAccept);
+            sqe->user_data = userData(TagCancel);
+        } else {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, listenSocket, nullptr);
+        }
+        close(listenSocket); // The successor's descriptor keeps the socket and its queue alive
+        listenSocket = -1;
+        draining = true;
+        
+        vector<ClientSession*> current;
+        for (auto& entry : sessions) current.push_back(entry.second.get());
+        for (ClientSession* session : current) {
+            closeIfDrained(*session);
+            if (session->closing) closeSession(*session);
+        }
+    }
+    
+private:
+    // Operation kinds carried in the top byte of io_uring user_data; the rest is the session id
+    enum UringTag : uint64_t { TagAccept = 1, TagWake, TagTick, TagRecv, TagWritable, TagCancel };
+    
+    int epollFd = -1;
+    int listenSocket = -1;
+    bool draining = false; // Replaced by a successor; sessions leave once idle
+    WakeQueue wakeQueue;
+    IoUring ring;
+    bool useUring = false;
+    struct __kernel_timespec tickInterval = {1, 0};
+    uint64_t nextSessionId = 0;
+    unordered_map<int, unique_ptr<ClientSession>> sessions;
+    TimingWheel idleTimers;
+    unordered_map<uint64_t, ClientSession*> sessionsById; // Resolves io_uring completions
+    // Closed during the current batch; freed after it, since later events may still point at them
+    vector<unique_ptr<ClientSession>> retiredSessions;
+    
+    static uint64_t userData(UringTag tag, uint64_t sessionId = 0) { return (uint64_t(tag) << 56) | sessionId; }
+    
+    // Completion-driven loop: a single io_uring_enter() submits new work and waits for results
+    void runUring() {
+        armAccept();
+        armWake();
+        armTick();
+        while (true) {
+            ring.submit(1);
+            ring.drain([this](const struct io_uring_cqe& cqe) { handleCompletion(cqe); });
+            retiredSessions.clear();
+        }
+    }
+    
+    void armAccept() {
+        struct io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listenSocket;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        sqe->user_data = userData(TagAccept);
+    }
+    
+    void armWake() {
+        struct io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = wakeQueue.descriptor();
+        sqe->poll32_events = POLLIN;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->user_data = userData(TagWake);
+    }
+    
+    void armTick() {
+        struct io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = reinterpret_cast<uint64_t>(&tickInterval);
+        sqe->len = 1;
+        sqe->user_data = userData(TagTick);
+    }
+    
+    // Multishot recv into provided buffers: one request serves every command the session sends
+    void armRecv(ClientSession& session) {
+        struct io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = session.socket;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        sqe->user_data = userData(TagRecv, session.id);
+    }
+    
+    // Replies normally leave in flushOutput(); only a full socket buffer needs a writability poll
+    void armWritePoll(ClientSession& session) {
+        if (!useUring || session.outQueue.empty() || session.writePollArmed) return;
+        struct io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = session.socket;
+        sqe->poll32_events = POLLOUT;
+        sqe->user_data = userData(TagWritable, session.id);
+        session.writePollArmed = true;
+    }
+    
+    void handleCompletion(const struct io_uring_cqe& cqe) {
+        UringTag tag = static_cast<UringTag>(cqe.user_data >> 56);
+        bool more = cqe.flags & IORING_CQE_F_MORE;
+        if (tag == TagCancel) return;
+        
+        if (tag == TagAccept) {
+            struct sockaddr_in clientAddr;
+            socklen_t clientAddrLen = sizeof(clientAddr);
+            if (cqe.res >= 0) {
+                if (getpeername(cqe.res, (struct sockaddr *)&clientAddr, &clientAddrLen) == 0) {
+                    openSession(cqe.res, clientAddr);
+                } else {
+                    close(cqe.res);
+                }
+            }
+            if (!more && listenSocket >= 0) armAccept();
+            return;
+        }
+        if (tag == TagWake) {
+            wakeQueue.runPending();
+            if (!more) armWake();
+            return;
+        }
+        if (tag == TagTick) {
+            expireIdleSessions(coarseNow());
+            armTick();
+            return;
+        }
+        
+        auto it = sessionsById.find(cqe.user_data & ((uint64_t(1) << 56) - 1));
+        ClientSession* session = it == sessionsById.end() ? nullptr : it->second;
+        if (tag == TagRecv) {
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                uint16_t bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                if (session && cqe.res > 0) consumeInput(*session, ring.buffer(bufferId), cqe.res);
+                ring.recycleBuffer(bufferId);
+            }
+            if (!session) return; // Completion for a session that is already closed
+            if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS)) {
+                if (!session->closing) log(cqe.res == 0 ? "Client disconnected" : "Read error", session);
+                session->closing = true;
+            } else if (!more && !session->closing) {
+                armRecv(*session); // Buffers ran out or the kernel ended the multishot
+            }
+        } else if (tag == TagWritable) {
+            if (!session) return;
+            session->writePollArmed = false;
+            if (cqe.res < 0 || (cqe.res & (POLLERR | POLLHUP))) session->closing = true;
+        }
+        if (!session) return;
+        
+        if (session->closing) {
+            closeSession(*session);
+        } else {
+            flushOutput(*session);
+            armWritePoll(*session);
+        }
+    }
+    
+    // Copy a received buffer into the session's framer, running commands as the framer fills
+    void consumeInput(ClientSession& session, const char* data, size_t length) {
+        while (length > 0 && !session.closing) {
+            if (!holdInputSpace(session)) return;
+            size_t chunk = min(length, session.input.writableBytes());
+            memcpy(session.input.writePointer(), data, chunk);
+            session.input.commit(chunk);
+            data += chunk;
+            length -= chunk;
+            dispatchCommands(session);
+        }
+    }
+    
+    void acceptClients() {
+        while (true) {
+            struct sockaddr_in clientAddr;
+            socklen_t clientAddrLen = sizeof(clientAddr);
+            int clientSocket = accept4(listenSocket, (struct sockaddr *)&clientAddr, &clientAddrLen,
+                                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (clientSocket < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                perror("Accept failed");
+                return;
+            }
+            
+            openSession(clientSocket, clientAddr);
+        }
+    }
+    
+    void openSession(int clientSocket, const struct sockaddr_in& clientAddr) {
+        if (draining) { // Completed by the ring just before the accept was cancelled
+            static const char reply[] = "421 Server restarting, please reconnect\r\n";
+            ssize_t ignored = send(clientSocket, reply, sizeof(reply) - 1, MSG_NOSIGNAL);
+            (void)ignored;
+            close(clientSocket);
+            return;
+        }
+        
+        // One host may hold at most limits.maxClients control sessions, except over loopback
+        int admissionSlot = admissionTable.acquire(clientAddr.sin_addr.s_addr);
+        if (admissionSlot < 0) {
+            static const char reply[] = "421 Too many connections from your address\r\n";
+            ssize_t ignored = send(clientSocket, reply, sizeof(reply) - 1, MSG_NOSIGNAL);
+            (void)ignored;
+            close(clientSocket);
+            log("Connection refused: per-address session limit", inet_ntoa(clientAddr.sin_addr), string());
+            return;
+        }
+        
+        int opt = 1;
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        
+        auto session = make_unique<ClientSession>();
+        session->admissionSlot = admissionSlot;
+        session->id = nextSessionId++;
+        session->loop = this;
+        session->socket = clientSocket;
+        session->clientIP = inet_ntoa(clientAddr.sin_addr);
+        session->authenticated = false;
+        session->lastActivity = coarseNow();
+        
+        if (useUring) {
+            armRecv(*session);
+        } else {
+            struct epoll_event ev = {};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.ptr = session.get();
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &ev) < 0) {
+                perror("epoll_ctl failed");
+                admissionTable.release(admissionSlot);
+                close(clientSocket);
+                return;
+            }
+        }
+        
+        metrics.activeSessions.fetch_add(1, memory_order_relaxed);
+        metrics.sessionsTotal.fetch_add(1, memory_order_relaxed);
+        log("New connection", session.get());
+        sendResponse(*session, "220 Welcome to Secure FTP Server\r\n");
+        flushOutput(*session);
+        armWritePoll(*session);
+        session->idleTimer.owner = session.get();
+        idleTimers.schedule(session->idleTimer, session->lastActivity + limits.sessionTimeout.load(memory_order_relaxed));
+        sessionsById[session->id] = session.get();
+        sessions[clientSocket] = move(session);
+    }
+    
+    // Run every buffered command in order; a pending login holds the rest back
+    void dispatchCommands(ClientSession& session) {
+        string command;
+        while (!session.closing && !session.authPending) {
+            LineFramer::Result result = session.input.nextLine(command);
+            if (result == LineFramer::Result::None) return;
+            if (result == LineFramer::Result::TooLong) {
+                sendResponse(session, "500 Command too long\r\n");
+                continue;
+            }
+            auto started = chrono::steady_clock::now();
+            size_t commandIndex = handleCommand(session, command);
+            long latencyNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count();
+            metrics.recordCommand(commandIndex, latencyNs);
+            logCommand(session, command, latencyNs / 1000);
+        }
+    }
+    
+    // Drain the socket; edge-triggered mode only reports new data once
+    void readCommands(ClientSession& session) {
+        while (!session.closing) {
+            if (!holdInputSpace(session)) return;
+            ssize_t valread = recv(session.socket, session.input.writePointer(), session.input.writableBytes(), 0);
+            if (valread < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                if (errno == EINTR) continue;
+            }
+            if (valread <= 0) {
+                log(valread == 0 ? "Client disconnected" : "Read error", &session);
+                session.closing = true;
+                return;
+            }
+            session.input.commit(valread);
+            dispatchCommands(session);
+        }
+    }
+    
+    // Input is only held back while a login is verified; a client that fills the buffer meanwhile is dropped
+    bool holdInputSpace(ClientSession& session) {
+        if (session.input.writableBytes() > 0) return true;
+        sendResponse(session, "421 Too much input while logging in\r\n");
+        log("Input overflow during pending login", &session);
+        session.closing = true;
+        return false;
+    }
+    
+    // While draining, a session is let go as soon as nothing is in flight for it
+    void closeIfDrained(ClientSession& session) {
+        if (!draining || session.closing || session.authPending || session.activeTransfers > 0) return;
+        sendResponse(session, "421 Server restarting, please reconnect\r\n");
+        log("Session closed for restart", &session);
+        session.closing = true;
+    }
+    
+    void closeSession(ClientSession& session) {
+        int socket = session.socket;
+        flushOutput(session); // Best effort for the final reply
+        if (session.passive) passivePortPool.release(session.passive);
+        if (useUring) shutdown(socket, SHUT_RDWR); // Pending ring requests hold the socket open until they fail
+        close(socket); // Also removes it from the epoll set
+        log("Connection closed", &session);
+        idleTimers.cancel(session.idleTimer);
+        admissionTable.release(session.admissionSlot);
+        metrics.activeSessions.fetch_sub(1, memory_order_relaxed);
+        session.socket = -1;
+        sessionsById.erase(session.id);
+        auto entry = sessions.find(socket);
+        retiredSessions.push_back(move(entry->second));
+        sessions.erase(entry);
+    }
+    
+    // Only timers that came due are visited; a session active since it was scheduled is pushed back
+    void expireIdleSessions(time_t now) {
+        vector<ClientSession*> expired;
+        unsigned int timeout = limits.sessionTimeout.load(memory_order_relaxed);
+        idleTimers.advance(now, [&](TimerNode& timer) {
+            ClientSession* session = static_cast<ClientSession*>(timer.owner);
+            time_t deadline = session->lastActivity + timeout;
+            if (deadline > now) {
+                idleTimers.schedule(timer, deadline);
+            } else if (session->activeTransfers > 0) {
+                idleTimers.schedule(timer, now + timeout); // Never expire mid-transfer
+            } else {
+                expired.push_back(session);
+            }
+        });
+        for (ClientSession* session : expired) {
+            sendResponse(*session, "421 Session timeout\r\n");
+            log("Session timed out", session);
+            closeSession(*session);
+        }
+    }
+};
+
+void notifyLoginResult(EventLoop* loop, int controlSocket, uint64_t sessionId, bool accepted) {
+    loop->post([loop, controlSocket, sessionId, accepted] { loop->completeLogin(controlSocket, sessionId, accepted); });
+}
+
+void notifyTransferDone(const DataTransfer& job, const string& reply) {
+    EventLoop* loop = job.loop;
+    int controlSocket = job.controlSocket;
+    uint64_t sessionId = job.sessionId;
+    loop->post([loop, controlSocket, sessionId, reply] { loop->completeTransfer(controlSocket, sessionId, reply); });
+}
+
+// Pick the I/O engine once at startup; io_uring is used only when the kernel supports every operation
+bool selectIoEngine() {
+    const char* requested = getenv("FTP_IO_ENGINE");
+    string engine = requested ? requested : IO_ENGINE;
+    if (engine == "epoll") return false;
+    
+    if (!IoUring::supported()) {
+        log("io_uring unavailable on this kernel; falling back to epoll");
+        return false;
+    }
+    return true;
+}
+
+// Re-read limits and credentials on SIGHUP; sessions and transfers carry on untouched
+void reloadOnHangup() {
+    sigset_t hangup;
+    sigemptyset(&hangup);
+    sigaddset(&hangup, SIGHUP);
+    while (true) {
+        int received;
+        if (sigwait(&hangup, &received) != 0) continue;
+        log("SIGHUP received; reloading configuration");
+        limits.load(SERVER_CONFIG_FILE);
+        applyLimits();
+        credentialStore.load(CREDENTIALS_FILE);
+    }
+}
+
+// Zero-downtime restart: a successor started with --takeover receives the listening sockets over
+// SCM_RIGHTS, so no connection is refused, plus the names of the hot cached files so it starts warm.
+// Once it confirms that its loops are running, this process stops accepting and drains.
+class Handover {
+public:
+    struct Inherited {
+        vector<int> controlListeners;
+        vector<pair<int, int>> passiveListeners; // Descriptor and port
+        vector<string> hotFiles;
+    };
+    
+    // Successor side; false means there was nobody to take over from
+    bool receive(Inherited& inherited) {
+        channel = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        struct sockaddr_un address = socketAddress();
+        if (channel < 0 || connect(channel, (struct sockaddr *)&address, sizeof(address)) < 0) {
+            log("No running server to take over from; starting cold");
+            if (channel >= 0) close(channel);
+            channel = -1;
+            return false;
+        }
+        struct timeval timeout = {HANDOVER_TIMEOUT_MS / 1000, 0};
+        setsockopt(channel, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        
+        vector<char> record(HANDOVER_RECORD_SIZE);
+        while (true) {
+            vector<int> fds;
+            ssize_t length = receiveRecord(record, fds);
+            RecordHeader header = {};
+            if (length >= static_cast<ssize_t>(sizeof(header))) memcpy(&header, record.data(), sizeof(header));
+            const char* payload = record.data() + sizeof(header);
+            size_t payloadLength = length - sizeof(header);
+            
+            if (header.kind == ControlListeners) {
+                inherited.controlListeners.insert(inherited.controlListeners.end(), fds.begin(), fds.end());
+            } else if (header.kind == PassiveListeners && payloadLength == fds.size() * sizeof(int32_t)) {
+                for (size_t i = 0; i < fds.size(); ++i) {
+                    int32_t port;
+                    memcpy(&port, payload + i * sizeof(port), sizeof(port));
+                    inherited.passiveListeners.push_back({fds[i], port});
+                }
+            } else if (header.kind == HotFiles) {
+                stringstream names(string(payload, payloadLength));
+                string name;
+                while (getline(names, name)) inherited.hotFiles.push_back(name);
+            } else if (header.kind == End) {
+                break;
+            } else {
+                // Truncated or garbled; the predecessor keeps serving once we are gone
+                perror("Handover failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        log("Took over " + to_string(inherited.controlListeners.size()) + " listeners and " +
+            to_string(inherited.passiveListeners.size()) + " passive ports");
+        return true;
+    }
+    
+    // Successor side: our loops are running, so the predecessor may stop accepting
+    void confirm() {
+        if (channel < 0) return;
+        char ready = 'R';
+        ssize_t ignored = send(channel, &ready, 1, MSG_NOSIGNAL);
+        (void)ignored;
+        close(channel);
+        channel = -1;
+    }
+    
+    // Predecessor side: wait for a successor for as long as this process runs
+    void start(vector<EventLoop*> eventLoops) {
+        loops = move(eventLoops);
+        listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        struct sockaddr_un address = socketAddress();
+        unlink(HANDOVER_SOCKET.c_str()); // Our predecessor's, or left behind by a previous run
+        
+        if (listenFd < 0 || bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+            chmod(HANDOVER_SOCKET.c_str(), 0600) < 0 || listen(listenFd, 1) < 0) {
+            perror("Handover socket setup failed");
+            exit(EXIT_FAILURE);
+        }
+        thread(&Handover::serve, this).detach();
+    }
+
+private:
+    enum RecordKind : uint32_t { ControlListeners = 1, PassiveListeners, HotFiles, End };
+    struct RecordHeader {
+        uint32_t kind;
+        uint32_t count;
+    };
+    
+    int channel = -1;   // Successor's connection to its predecessor
+    int listenFd = -1;
+    vector<EventLoop*> loops;
+    
+    static struct sockaddr_un socketAddress() {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, HANDOVER_SOCKET.c_str(), sizeof(address.sun_path) - 1);
+        return address;
+    }
+    
+    // One SEQPACKET record: header, optional payload and up to HANDOVER_BATCH descriptors
+    static bool sendRecord(int peer, RecordKind kind, const vector<int>& fds, const string& payload) {
+        RecordHeader header = {kind, static_cast<uint32_t>(fds.size())};
+        struct iovec iov[2];
+        iov[0].iov_base = &header;
+        iov[0].iov_len = sizeof(header);
+        iov[1].iov_base = const_cast<char*>(payload.data());
+        iov[1].iov_len = payload.size();
+        
+        struct msghdr message = {};
+        message.msg_iov = iov;
+        message.msg_iovlen = 2;
+        vector<char> control(CMSG_SPACE(sizeof(int) * max<size_t>(fds.size(), 1)));
+        if (!fds.empty()) {
+            message.msg_control = control.data();
+            message.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+            memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+        }
+        return sendmsg(peer, &message, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(header) + payload.size());
+    }
+    
+    // Descriptors arrive close-on-exec; a truncated record is reported as an error
+    ssize_t receiveRecord(vector<char>& buffer, vector<int>& fds) {
+        struct iovec iov = {buffer.data(), buffer.size()};
+        vector<char> control(CMSG_SPACE(sizeof(int) * HANDOVER_BATCH));
+        struct msghdr message = {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+        
+        ssize_t length;
+        do {
+            length = recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+        } while (length < 0 && errno == EINTR);
+        if (length < 0) return -1;
+        
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t first = fds.size();
+            fds.resize(first + count);
+            memcpy(fds.data() + first, CMSG_DATA(cmsg), count * sizeof(int));
+        }
+        return message.msg_flags & (MSG_TRUNC | MSG_CTRUNC) ? -1 : length;
+    }
+    
+    void serve() {
+        while (true) {
+            int successor = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (successor < 0) {
+                if (errno != EINTR) this_thread::sleep_for(chrono::milliseconds(100));
+                continue;
+            }
+            bool handedOver = handOver(successor);
+            close(successor);
+            if (handedOver) drainAndExit();
+        }
+    }
+    
+    bool handOver(int successor) {
+        log("Successor connected; handing over listeners");
+        vector<int> control;
+        for (EventLoop* loop : loops) control.push_back(loop->listener());
+        bool sent = sendRecord(successor, ControlListeners, control, "");
+        
+        vector<PassiveListener*> passive = passivePortPool.surrender();
+        for (size_t first = 0; sent && first < passive.size(); first += HANDOVER_BATCH) {
+            vector<int> fds;
+            string ports;
+            for (size_t i = first; i < min(passive.size(), first + HANDOVER_BATCH); ++i) {
+                int32_t port = passive[i]->port;
+                fds.push_back(passive[i]->fd);
+                ports.append(reinterpret_cast<const char*>(&port), sizeof(port));
+            }
+            sent = sendRecord(successor, PassiveListeners, fds, ports);
+        }
+        
+        string names;
+        for (const string& name : fileCache.hotFiles()) {
+            if (names.size() + name.size() + 1 > HANDOVER_RECORD_SIZE - sizeof(RecordHeader)) {
+                sent = sent && sendRecord(successor, HotFiles, {}, names);
+                names.clear();
+            }
+            names += name + "\n";
+        }
+        if (!names.empty()) sent = sent && sendRecord(successor, HotFiles, {}, names);
+        sent = sent && sendRecord(successor, End, {}, "");
+        
+        // The successor answers once its event loops run on the inherited listeners
+        struct pollfd ready = {successor, POLLIN, 0};
+        char answer = 0;
+        bool confirmed = sent && poll(&ready, 1, HANDOVER_TIMEOUT_MS) == 1 &&
+                         recv(successor, &answer, 1, 0) == 1 && answer == 'R';
+        if (!confirmed) {
+            passivePortPool.restore(passive);
+            log("Handover aborted; continuing to serve");
+            return false;
+        }
+        
+        passivePortPool.retire(passive);
+        for (EventLoop* loop : loops) loop->post([loop] { loop->beginDrain(); });
+        log("Handover complete; draining " + to_string(metrics.activeSessions.load()) + " sessions");
+        return true;
+    }
+    
+    // Exit once every session and transfer is gone, or after DRAIN_TIMEOUT regardless
+    void drainAndExit() {
+        time_t deadline = coarseNow() + DRAIN_TIMEOUT;
+        while ((metrics.activeSessions.load() > 0 || metrics.activeTransfers.load() > 0) && coarseNow() < deadline) {
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+        log("Drain finished with " + to_string(metrics.activeSessions.load()) + " sessions left; exiting");
+        sidecarCache.discard();
+        this_thread::sleep_for(chrono::milliseconds(LOG_FLUSH_INTERVAL_MS * 5)); // Let the logger write the last records
+        _exit(EXIT_SUCCESS);
+    }
+};
+
+Handover handover;
+
+int main(int argc, char* argv[]) {
+    // "--add-user NAME" appends a credential (password on stdin) and exits
+    if (argc == 3 && string(argv[1]) == "--add-user") return addUser(argv[2]);
+    // "--takeover" inherits the listeners of a running server, which then drains and exits
+    bool takeover = argc == 2 && string(argv[1]) == "--takeover";
+    
+    // Peers that disconnect mid-transfer must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+    
+    // SIGHUP is taken synchronously by the reload thread; every thread started below inherits the mask
+    sigset_t hangup;
+    sigemptyset(&hangup);
+    sigaddset(&hangup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hangup, nullptr);
+    
+    // Thousands of sessions plus the passive port pool need more than the default descriptor limit
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    
+    // Create public folder with secure permissions
+    mkdir(PUBLIC_FOLDER.c_str(), 0755); // Restrictive permissions
+    asyncLogger.start();
+    metrics.start();
+    limits.load(SERVER_CONFIG_FILE);
+    applyLimits();
+    credentialStore.load(CREDENTIALS_FILE);
+    authWorkers.start(AUTH_WORKER_THREADS);
+    thread(reloadOnHangup).detach();
+    directoryIndex.start();
+    sidecarCache.start();
+    Handover::Inherited inherited;
+    if (takeover) handover.receive(inherited);
+    passivePortPool.start(inherited.passiveListeners);
+    uringEngine = selectIoEngine();
+    dataWorkers.start(DATA_WORKER_THREADS);
+    
+    // Warm the file cache with what the predecessor was serving before taking any traffic
+    for (const string& name : inherited.hotFiles) fileCache.acquire(name);
+    
+    // One event loop per core, each with its own SO_REUSEPORT listener; every inherited listener needs a loop
+    unsigned int loopCount = max<size_t>({1u, thread::hardware_concurrency(), inherited.controlListeners.size()});
+    vector<unique_ptr<EventLoop>> loops;
+    vector<EventLoop*> loopPointers;
+    for (unsigned int i = 0; i < loopCount; ++i) {
+        loops.push_back(make_unique<EventLoop>(i < inherited.controlListeners.size() ? inherited.controlListeners[i] : -1));
+        loopPointers.push_back(loops.back().get());
+    }
+    
+    log("Secure FTP Server started on port " + to_string(FTP_PORT) +
+        " with " + to_string(loopCount) + " event loops (" + (uringEngine ? "io_uring" : "epoll") + ")");
+    log("Sharing files from: " + PUBLIC_FOLDER);
+    
+    vector<thread> loopThreads;
+    for (unsigned int i = 1; i < loopCount; ++i) {
+        loopThreads.emplace_back(&EventLoop::run, loops[i].get());
     }
+    handover.confirm(); // Loop 0 accepts as soon as run() starts; its queue holds connections until then
+    handover.start(loopPointers);
+    loops[0]->run();
     
-    close(serverSocket);
+    for (auto& t : loopThreads) t.join();
     return 0;
 }
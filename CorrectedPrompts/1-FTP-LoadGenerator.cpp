@@ -0,0 +1,386 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Load generator for 1-FTP-Corrected.cpp: drives N concurrent control sessions over
+// loopback through a weighted USER/PASS/LIST/SIZE/RETR mix and reports per-command latency.
+
+// Defaults, all overridable from the command line
+const string DEFAULT_HOST = "127.0.0.1";
+const int DEFAULT_PORT = 2121;
+// The server must know this login: echo PASSWORD | ./1-FTP-Corrected --add-user ftpuser
+// There is no default password; it is whatever was stored with --add-user, given as --pass
+const string DEFAULT_USER = "ftpuser";
+const string FIXTURE_FOLDER = "./public";
+const int DEFAULT_SESSIONS = 32;
+const int DEFAULT_DURATION = 10;    // Seconds
+const int DEFAULT_FIXTURE_FILES = 64;
+const size_t MAX_REPLY_LENGTH = 4096;
+const int RETRY_DELAY_MS = 100;     // Pause before reconnecting after a failed connect or login
+
+struct Options {
+    string host = DEFAULT_HOST;
+    int port = DEFAULT_PORT;
+    string user = DEFAULT_USER;
+    string pass;
+    int sessions = DEFAULT_SESSIONS;
+    int duration = DEFAULT_DURATION;
+    int fixtureFiles = DEFAULT_FIXTURE_FILES;
+    string mix = "LIST:1,SIZE:4,RETR:2";
+    string reportFile;
+};
+
+// Latencies and counters collected by one session thread, merged at the end
+struct CommandStats {
+    vector<long> latenciesUs;
+    long errors = 0;
+    long bytes = 0;
+};
+
+using StatsTable = map<string, CommandStats>;
+
+// Blocking control connection with a line-oriented reply reader
+class FtpConnection {
+public:
+    ~FtpConnection() {
+        if (sock >= 0) close(sock);
+    }
+
+    bool connectTo(const string& host, int port) {
+        sock = openSocket(host, port);
+        if (sock < 0) return false;
+        int opt = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        return readReply() == 220;
+    }
+
+    // Send one command and return the final reply code, or -1 on a broken connection
+    int command(const string& line) {
+        string wire = line + "\r\n";
+        if (send(sock, wire.data(), wire.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(wire.size())) return -1;
+        return readReply();
+    }
+
+    // Read a complete (possibly multi-line) reply and return its code
+    int readReply() {
+        while (true) {
+            string line;
+            if (!readLine(line) || line.size() < 3) return -1;
+            lastReply = line;
+            if (line.size() == 3 || line[3] != '-') {
+                if (!isdigit(line[0])) continue; // Continuation text of a multi-line reply
+                return stoi(line.substr(0, 3));
+            }
+        }
+    }
+
+    const string& reply() const { return lastReply; }
+
+    // Open the data connection announced by a 227 reply
+    int openPassive(const string& host) {
+        size_t open = lastReply.find('(');
+        size_t closeParen = lastReply.find(')', open);
+        if (open == string::npos || closeParen == string::npos) return -1;
+
+        int parts[6];
+        stringstream fields(lastReply.substr(open + 1, closeParen - open - 1));
+        string field;
+        for (int i = 0; i < 6; ++i) {
+            if (!getline(fields, field, ',')) return -1;
+            parts[i] = stoi(field);
+        }
+        return openSocket(host, parts[4] * 256 + parts[5]);
+    }
+
+    static int openSocket(const string& host, int port) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+            connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+private:
+    int sock = -1;
+    string buffered;
+    string lastReply;
+
+    bool readLine(string& line) {
+        while (true) {
+            size_t end = buffered.find("\r\n");
+            if (end != string::npos) {
+                line = buffered.substr(0, end);
+                buffered.erase(0, end + 2);
+                return true;
+            }
+            if (buffered.size() > MAX_REPLY_LENGTH) return false;
+
+            char chunk[1024];
+            ssize_t n = recv(sock, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buffered.append(chunk, n);
+        }
+    }
+};
+
+// Drain a data connection and return the number of bytes received
+long drainData(int fd) {
+    static thread_local vector<char> buffer(256 * 1024);
+    long total = 0;
+    while (true) {
+        ssize_t n = recv(fd, buffer.data(), buffer.size(), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        total += n;
+    }
+    close(fd);
+    return total;
+}
+
+// Populate the fixture folder with deterministic files of mixed sizes
+vector<string> createFixture(int count) {
+    mkdir(FIXTURE_FOLDER.c_str(), 0755);
+    const size_t sizes[] = {512, 4 * 1024, 64 * 1024, 512 * 1024, 4 * 1024 * 1024};
+    vector<string> names;
+    mt19937 generator(42);
+
+    for (int i = 0; i < count; ++i) {
+        size_t size = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+        string name = "loadgen-" + to_string(i) + "-" + to_string(size) + ".bin";
+        names.push_back(name);
+
+        string path = FIXTURE_FOLDER + "/" + name;
+        struct stat stat_buf;
+        if (stat(path.c_str(), &stat_buf) == 0 && static_cast<size_t>(stat_buf.st_size) == size) continue;
+
+        string contents(size, '\0');
+        for (char& c : contents) c = static_cast<char>(generator());
+        ofstream out(path, ios::binary | ios::trunc);
+        out.write(contents.data(), contents.size());
+    }
+    return names;
+}
+
+// Parse "LIST:1,SIZE:4,RETR:2" into a weighted command list
+vector<string> parseMix(const string& mix) {
+    vector<string> weighted;
+    stringstream entries(mix);
+    string entry;
+    while (getline(entries, entry, ',')) {
+        size_t colon = entry.find(':');
+        string name = entry.substr(0, colon);
+        int weight = colon == string::npos ? 1 : stoi(entry.substr(colon + 1));
+        transform(name.begin(), name.end(), name.begin(), ::toupper);
+        if (name != "LIST" && name != "SIZE" && name != "RETR" && name != "NOOP") {
+            throw runtime_error("Unsupported command in mix: " + name);
+        }
+        for (int i = 0; i < weight; ++i) weighted.push_back(name);
+    }
+    if (weighted.empty()) throw runtime_error("Empty command mix");
+    return weighted;
+}
+
+// Time one scripted operation; LIST and RETR include PASV, the data stream and the 226
+bool runOperation(FtpConnection& conn, const Options& options, const string& op, const string& file,
+                  StatsTable& stats) {
+    auto started = chrono::steady_clock::now();
+    bool ok = false;
+    long bytes = 0;
+
+    if (op == "SIZE") {
+        ok = conn.command("SIZE " + file) == 213;
+    } else if (op == "NOOP") {
+        ok = conn.command("NOOP") == 200;
+    } else if (conn.command("PASV") == 227) {
+        int dataFd = conn.openPassive(options.host);
+        if (dataFd >= 0) {
+            int code = conn.command(op == "LIST" ? "LIST" : "RETR " + file);
+            if (code == 150) {
+                bytes = drainData(dataFd);
+                ok = conn.readReply() == 226;
+            } else {
+                close(dataFd);
+            }
+        }
+    }
+
+    long latencyUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started).count();
+    CommandStats& entry = stats[op];
+    entry.latenciesUs.push_back(latencyUs);
+    entry.bytes += bytes;
+    if (!ok) entry.errors++;
+    return ok;
+}
+
+// One control session: log in, then run the weighted mix until the deadline
+void runSession(const Options& options, const vector<string>& mix, const vector<string>& files,
+                chrono::steady_clock::time_point deadline, unsigned int seed, StatsTable& stats) {
+    mt19937 generator(seed);
+
+    while (chrono::steady_clock::now() < deadline) {
+        FtpConnection conn;
+        auto started = chrono::steady_clock::now();
+        if (!conn.connectTo(options.host, options.port)) {
+            stats["CONNECT"].errors++;
+            this_thread::sleep_for(chrono::milliseconds(RETRY_DELAY_MS));
+            continue;
+        }
+        stats["CONNECT"].latenciesUs.push_back(
+            chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started).count());
+
+        started = chrono::steady_clock::now();
+        bool loggedIn = conn.command("USER " + options.user) == 331 && conn.command("PASS " + options.pass) == 230;
+        // Rejected logins (wrong password, server at its admission cap) get their own row so
+        // they neither count as LOGIN throughput nor retry in a tight loop
+        CommandStats& login = stats[loggedIn ? "LOGIN" : "LOGIN_FAILED"];
+        login.latenciesUs.push_back(
+            chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started).count());
+        if (!loggedIn) {
+            login.errors++;
+            this_thread::sleep_for(chrono::milliseconds(RETRY_DELAY_MS));
+            continue;
+        }
+
+        while (chrono::steady_clock::now() < deadline) {
+            const string& op = mix[generator() % mix.size()];
+            const string& file = files[generator() % files.size()];
+            if (!runOperation(conn, options, op, file, stats)) break; // Reconnect after any failure
+        }
+        conn.command("QUIT");
+    }
+}
+
+long percentile(const vector<long>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    size_t index = min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+    return sorted[index];
+}
+
+// Machine-readable summary so builds can be compared
+string buildReport(const Options& options, const StatsTable& merged, double seconds) {
+    stringstream json;
+    json << "{\n  \"sessions\": " << options.sessions << ",\n  \"duration_s\": " << seconds
+         << ",\n  \"mix\": \"" << options.mix << "\",\n  \"commands\": {";
+
+    bool first = true;
+    for (const auto& entry : merged) {
+        vector<long> sorted = entry.second.latenciesUs;
+        sort(sorted.begin(), sorted.end());
+        json << (first ? "\n" : ",\n") << "    \"" << entry.first << "\": {"
+             << "\"count\": " << sorted.size()
+             << ", \"errors\": " << entry.second.errors
+             << ", \"ops_per_s\": " << static_cast<long>(sorted.size() / seconds)
+             << ", \"bytes\": " << entry.second.bytes
+             << ", \"p50_us\": " << percentile(sorted, 0.50)
+             << ", \"p99_us\": " << percentile(sorted, 0.99)
+             << ", \"p999_us\": " << percentile(sorted, 0.999)
+             << ", \"max_us\": " << (sorted.empty() ? 0 : sorted.back()) << "}";
+        first = false;
+    }
+    json << "\n  }\n}\n";
+    return json.str();
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) throw runtime_error("Missing value for " + arg);
+        string value = argv[++i];
+
+        if (arg == "--host") options.host = value;
+        else if (arg == "--port") options.port = stoi(value);
+        else if (arg == "--user") options.user = value;
+        else if (arg == "--pass") options.pass = value;
+        else if (arg == "--sessions") options.sessions = stoi(value);
+        else if (arg == "--duration") options.duration = stoi(value);
+        else if (arg == "--files") options.fixtureFiles = stoi(value);
+        else if (arg == "--mix") options.mix = value;
+        else if (arg == "--report") options.reportFile = value;
+        else throw runtime_error("Unknown option " + arg);
+    }
+    if (options.sessions < 1 || options.duration < 1 || options.fixtureFiles < 1) {
+        throw runtime_error("--sessions, --duration and --files must be positive");
+    }
+    if (options.pass.empty()) throw runtime_error("--pass is required");
+    return options;
+}
+
+int main(int argc, char* argv[]) {
+    signal(SIGPIPE, SIG_IGN);
+
+    Options options;
+    vector<string> mix;
+    try {
+        options = parseOptions(argc, argv);
+        mix = parseMix(options.mix);
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << "\n"
+             << "Usage: " << argv[0] << " --pass P [--host H] [--port P] [--user U] [--sessions N]\n"
+             << "       [--duration SECONDS] [--files N] [--mix LIST:1,SIZE:4,RETR:2] [--report FILE]\n";
+        return 1;
+    }
+
+    // The server must share this working directory so both see the same fixture
+    vector<string> files = createFixture(options.fixtureFiles);
+    cerr << "Fixture ready: " << files.size() << " files in " << FIXTURE_FOLDER << "\n";
+
+    vector<StatsTable> perSession(options.sessions);
+    vector<thread> threads;
+    auto started = chrono::steady_clock::now();
+    auto deadline = started + chrono::seconds(options.duration);
+    for (int i = 0; i < options.sessions; ++i) {
+        threads.emplace_back(runSession, cref(options), cref(mix), cref(files), deadline, 1000u + i,
+                             ref(perSession[i]));
+    }
+    for (auto& t : threads) t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    StatsTable merged;
+    for (const StatsTable& table : perSession) {
+        for (const auto& entry : table) {
+            CommandStats& target = merged[entry.first];
+            target.latenciesUs.insert(target.latenciesUs.end(), entry.second.latenciesUs.begin(),
+                                      entry.second.latenciesUs.end());
+            target.errors += entry.second.errors;
+            target.bytes += entry.second.bytes;
+        }
+    }
+
+    string report = buildReport(options, merged, seconds);
+    cout << report;
+    if (!options.reportFile.empty()) {
+        ofstream out(options.reportFile, ios::trunc);
+        out << report;
+    }
+    return 0;
+}
@@ -2,6 +2,32 @@
 #include <string>
 #include <regex>
 #include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include <deque>
+#include <string_view>
+#include <charconv>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <array>
+#include <random>
+#include <functional>
+#include <future>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sqlite3.h>
 
 // Constants for input validation
@@ -10,6 +36,73 @@ const int MAX_EMAIL_LENGTH = 254;
 const int MIN_AGE = 1;
 const int MAX_AGE = 120;
 
+// Rows per COMMIT on the bulk insert path
+const size_t DEFAULT_COMMIT_BATCH_SIZE = 10000;
+
+// Connection pool tuning
+const int READER_CONNECTIONS = 4;
+const size_t STATEMENT_CACHE_CAPACITY = 32;           // Prepared statements kept per connection
+const long long MMAP_SIZE_BYTES = 256LL * 1024 * 1024;
+const int CACHE_SIZE_KIB = 64 * 1024;                 // Page cache per connection
+const int BUSY_TIMEOUT_MS = 5000;
+
+const char* const SCHEMA_SQL =
+    "CREATE TABLE IF NOT EXISTS Users ("
+    "ID INTEGER PRIMARY KEY, Name TEXT NOT NULL, Age INTEGER NOT NULL, Email TEXT NOT NULL);"
+    "CREATE UNIQUE INDEX IF NOT EXISTS UsersByEmail ON Users (Email);"
+    "CREATE INDEX IF NOT EXISTS UsersByAge ON Users (Age);"; // Index entries end in the rowid: (Age, ID) order
+const char* const INSERT_USER_SQL = "INSERT INTO Users (Name, Age, Email) VALUES (?, ?, ?);";
+// The importer skips addresses that are already registered instead of failing the batch
+const char* const IMPORT_USER_SQL = "INSERT OR IGNORE INTO Users (Name, Age, Email) VALUES (?, ?, ?);";
+const char* const FIND_USER_BY_EMAIL_SQL = "SELECT ID, Name, Age, Email FROM Users WHERE Email = ?;";
+const char* const FIND_USER_BY_ID_SQL = "SELECT ID, Name, Age, Email FROM Users WHERE ID = ?;";
+// Keyset pages over (Age, ID) as two index seeks: the rest of the cursor's age, then the ages after
+// it. A single "(Age, ID) > (?, ?)" only seeks on Age and filters the IDs it skips.
+const char* const LIST_USERS_SAME_AGE_SQL =
+    "SELECT ID, Name, Age, Email FROM Users INDEXED BY UsersByAge WHERE Age = ?1 AND ID > ?2 ORDER BY ID LIMIT ?3;";
+const char* const LIST_USERS_LATER_AGES_SQL =
+    "SELECT ID, Name, Age, Email FROM Users INDEXED BY UsersByAge "
+    "WHERE Age > ?1 AND Age <= ?2 ORDER BY Age, ID LIMIT ?3;";
+
+// Bulk import pipeline
+const size_t IMPORT_CHUNK_BYTES = 4 * 1024 * 1024;  // Input handed to a worker at a time
+const size_t IMPORT_QUEUE_DEPTH = 8;                // Chunks waiting per stage; bounds resident input
+const int IMPORT_PROGRESS_INTERVAL_S = 1;
+const size_t IMPORT_REJECT_REPORT_LIMIT = 20;       // Rejected rows described on stderr; the rest are only counted
+
+// Write-behind group commit
+const int WRITE_BEHIND_WINDOW_US = 1000;            // How long a group stays open after its first row
+const size_t WRITE_BEHIND_MAX_GROUP = 1000;         // Rows that close a group early
+
+// Read benchmark (--bench-read) on its own database so the user table is never touched
+const char* const READ_BENCH_DB = "read_bench.db";
+const size_t READ_BENCH_ROWS = 10000000;
+// Rows written alongside the lookups; synthetic users are "user<N>@example.com"
+const std::string READ_BENCH_WRITER_EMAIL_PREFIX = "bench";
+const char* const READ_BENCH_REMOVE_WRITER_ROWS_SQL = "DELETE FROM Users WHERE Email >= 'bench' AND Email < 'benci';";
+const size_t READ_BENCH_LOOKUPS = 200000;           // Per lookup kind, split across the readers
+const size_t READ_BENCH_PAGE_SIZE = 1000;
+const int READ_BENCH_SCAN_MIN_AGE = 30;
+const int READ_BENCH_SCAN_MAX_AGE = 39;
+
+// Email validator self-check
+const int EMAIL_CHECK_EXHAUSTIVE_LENGTH = 6;
+const size_t EMAIL_CHECK_RANDOM_COUNT = 200000;
+
+// One registration as handed to the bulk insert path
+struct UserRecord {
+    std::string name;
+    int age;
+    std::string email;
+};
+
+// A row parsed in place by the importer; the text lives in the input mapping or a chunk arena
+struct UserRowView {
+    std::string_view name;
+    int age;
+    std::string_view email;
+};
+
 // Secure input function
 template<typename T>
 T getSecureInput(const std::string& prompt, T min = std::numeric_limits<T>::min(), 
@@ -17,7 +110,7 @@ T getSecureInput(const std::string& prompt, T min = std::numeric_limits<T>::min(
     T value;
     while (true) {
         std::cout << prompt;
-        if (!(std::cin >> value) {
+        if (!(std::cin >> value)) {
             std::cin.clear();
             std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
             std::cerr << "Invalid input. Please try again.\n";
@@ -33,40 +126,273 @@ T getSecureInput(const std::string& prompt, T min = std::numeric_limits<T>::min(
     return value;
 }
 
+// Email validation as a DFA that accepts exactly ^[a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,}$.
+// The top-level label cannot contain a dot, so it is whatever follows the last dot; the Tld states
+// count its letters, and any digit or hyphen after that dot falls back to Domain.
+enum EmailCharClass : uint8_t { EmailLetter, EmailDigit, EmailHyphen, EmailDot, EmailAt, EmailLocalSymbol, EmailOther };
+enum EmailState : uint8_t { EmailStart, EmailLocal, EmailDomainStart, EmailDomain, EmailAfterDot,
+                            EmailTldOne, EmailTldTwo, EmailReject };
+
+constexpr std::array<uint8_t, 256> buildEmailClasses() {
+    std::array<uint8_t, 256> classes{};
+    for (int c = 0; c < 256; ++c) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) classes[c] = EmailLetter;
+        else if (c >= '0' && c <= '9') classes[c] = EmailDigit;
+        else if (c == '-') classes[c] = EmailHyphen;
+        else if (c == '.') classes[c] = EmailDot;
+        else if (c == '@') classes[c] = EmailAt;
+        else if (c == '_' || c == '%' || c == '+') classes[c] = EmailLocalSymbol;
+        else classes[c] = EmailOther;
+    }
+    return classes;
+}
+
+constexpr std::array<uint8_t, 256> EMAIL_CLASSES = buildEmailClasses();
+
+// Rows are states, columns the character classes in EmailCharClass order
+constexpr uint8_t EMAIL_TRANSITIONS[8][7] = {
+    /* Start       */ {EmailLocal, EmailLocal, EmailLocal, EmailLocal, EmailReject, EmailLocal, EmailReject},
+    /* Local       */ {EmailLocal, EmailLocal, EmailLocal, EmailLocal, EmailDomainStart, EmailLocal, EmailReject},
+    /* DomainStart */ {EmailDomain, EmailDomain, EmailDomain, EmailDomain, EmailReject, EmailReject, EmailReject},
+    /* Domain      */ {EmailDomain, EmailDomain, EmailDomain, EmailAfterDot, EmailReject, EmailReject, EmailReject},
+    /* AfterDot    */ {EmailTldOne, EmailDomain, EmailDomain, EmailAfterDot, EmailReject, EmailReject, EmailReject},
+    /* TldOne      */ {EmailTldTwo, EmailDomain, EmailDomain, EmailAfterDot, EmailReject, EmailReject, EmailReject},
+    /* TldTwo      */ {EmailTldTwo, EmailDomain, EmailDomain, EmailAfterDot, EmailReject, EmailReject, EmailReject},
+    /* Reject      */ {EmailReject, EmailReject, EmailReject, EmailReject, EmailReject, EmailReject, EmailReject},
+};
+
+// Class and transition tables folded into one byte per (state, character): a single load per step
+constexpr std::array<std::array<uint8_t, 256>, 8> buildEmailDfa() {
+    std::array<std::array<uint8_t, 256>, 8> dfa{};
+    for (int state = 0; state < 8; ++state) {
+        for (int c = 0; c < 256; ++c) dfa[state][c] = EMAIL_TRANSITIONS[state][EMAIL_CLASSES[c]];
+    }
+    return dfa;
+}
+
+constexpr std::array<std::array<uint8_t, 256>, 8> EMAIL_DFA = buildEmailDfa();
+
 // Validate email format
-bool isValidEmail(const std::string& email) {
-    const std::regex pattern(R"(^[a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,}$)");
-    return std::regex_match(email, pattern) && email.length() <= MAX_EMAIL_LENGTH;
+bool isValidEmail(std::string_view email) {
+    if (email.length() > MAX_EMAIL_LENGTH) return false;
+    uint8_t state = EmailStart;
+    for (unsigned char c : email) state = EMAIL_DFA[state][c];
+    return state == EmailTldTwo;
+}
+
+// Validate many addresses at once, four in lockstep so their table lookups overlap.
+// Returns the number of valid addresses.
+size_t validateEmails(const std::string_view* emails, size_t count, bool* valid) {
+    size_t accepted = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const unsigned char* text[4];
+        for (int lane = 0; lane < 4; ++lane) text[lane] = reinterpret_cast<const unsigned char*>(emails[i + lane].data());
+        size_t shared = std::min({emails[i].size(), emails[i + 1].size(), emails[i + 2].size(), emails[i + 3].size(),
+                                  static_cast<size_t>(MAX_EMAIL_LENGTH)});
+
+        // Separate locals keep the four chains in registers
+        uint8_t s0 = EmailStart, s1 = EmailStart, s2 = EmailStart, s3 = EmailStart;
+        for (size_t k = 0; k < shared; ++k) {
+            s0 = EMAIL_DFA[s0][text[0][k]];
+            s1 = EMAIL_DFA[s1][text[1][k]];
+            s2 = EMAIL_DFA[s2][text[2][k]];
+            s3 = EMAIL_DFA[s3][text[3][k]];
+        }
+        uint8_t state[4] = {s0, s1, s2, s3};
+        for (int lane = 0; lane < 4; ++lane) {
+            size_t length = emails[i + lane].size();
+            for (size_t k = shared; k < length && k < MAX_EMAIL_LENGTH; ++k) state[lane] = EMAIL_DFA[state[lane]][text[lane][k]];
+            valid[i + lane] = state[lane] == EmailTldTwo && length <= MAX_EMAIL_LENGTH;
+            accepted += valid[i + lane];
+        }
+    }
+    for (; i < count; ++i) {
+        valid[i] = isValidEmail(emails[i]);
+        accepted += valid[i];
+    }
+    return accepted;
 }
 
+// The documented pattern, kept as the reference for checkEmailValidator()
+bool isValidEmailRegex(std::string_view email) {
+    static const std::regex pattern(R"(^[a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,}$)");
+    return std::regex_match(email.begin(), email.end(), pattern) && email.length() <= MAX_EMAIL_LENGTH;
+}
+
+// One SQLite connection, used by one thread at a time, with an LRU cache of prepared statements
+class PooledConnection {
+public:
+    PooledConnection(const std::string& dbName, bool readOnly) {
+        int flags = readOnly ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+        if (sqlite3_open_v2(dbName.c_str(), &db, flags | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+            sqlite3_close(db);
+            throw std::runtime_error("Unable to open database");
+        }
+        sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+
+        // WAL lets readers run alongside the writer; NORMAL only syncs the WAL at checkpoints
+        std::string pragmas = "PRAGMA mmap_size=" + std::to_string(MMAP_SIZE_BYTES) + ";"
+                              "PRAGMA cache_size=-" + std::to_string(CACHE_SIZE_KIB) + ";";
+        if (readOnly) {
+            pragmas += "PRAGMA query_only=ON;";
+        } else {
+            pragmas = "PRAGMA journal_mode=WAL;PRAGMA synchronous=NORMAL;" + pragmas;
+        }
+        sqlite3_exec(db, pragmas.c_str(), nullptr, nullptr, nullptr);
+    }
+
+    ~PooledConnection() {
+        for (auto& entry : statements) sqlite3_finalize(entry.second);
+        sqlite3_close(db);
+    }
+
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+
+    sqlite3* handle() const { return db; }
+
+    // Cached statement for sql, reset and unbound; stays valid until STATEMENT_CACHE_CAPACITY
+    // other statements have been prepared on this connection
+    sqlite3_stmt* prepare(const std::string& sql) {
+        auto found = index.find(sql);
+        if (found != index.end()) {
+            statements.splice(statements.begin(), statements, found->second);
+            sqlite3_stmt* stmt = found->second->second;
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+            return stmt;
+        }
+
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare statement");
+        }
+        statements.emplace_front(sql, stmt);
+        index[sql] = statements.begin();
+        if (statements.size() > STATEMENT_CACHE_CAPACITY) {
+            sqlite3_finalize(statements.back().second);
+            index.erase(statements.back().first);
+            statements.pop_back();
+        }
+        return stmt;
+    }
+
+private:
+    sqlite3* db = nullptr;
+    std::list<std::pair<std::string, sqlite3_stmt*>> statements; // Most recently used first
+    std::unordered_map<std::string, std::list<std::pair<std::string, sqlite3_stmt*>>::iterator> index;
+};
+
+// Process-wide pool per database file: one writer and READER_CONNECTIONS read-only connections
+class ConnectionPool {
+public:
+    // Exclusive use of one connection, handed back when the lease goes out of scope
+    class Lease {
+    public:
+        Lease(ConnectionPool* pool, PooledConnection* connection) : pool(pool), connection(connection) {}
+        Lease(Lease&& other) noexcept : pool(other.pool), connection(other.connection) { other.connection = nullptr; }
+        ~Lease() { if (connection) pool->giveBack(connection); }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        PooledConnection* operator->() const { return connection; }
+
+    private:
+        ConnectionPool* pool;
+        PooledConnection* connection;
+    };
+
+    // Opened on first use and kept for the life of the process; nullptr if the database cannot be opened
+    static ConnectionPool* forDatabase(const std::string& dbName) {
+        static std::mutex poolsMutex;
+        static std::map<std::string, std::unique_ptr<ConnectionPool>> pools;
+
+        std::lock_guard<std::mutex> guard(poolsMutex);
+        std::unique_ptr<ConnectionPool>& pool = pools[dbName];
+        if (!pool) {
+            try {
+                pool.reset(new ConnectionPool(dbName));
+            } catch (const std::exception&) {
+                pools.erase(dbName);
+                return nullptr;
+            }
+        }
+        return pool.get();
+    }
+
+    // SQLite admits one writer at a time, so writers queue here instead of on SQLITE_BUSY
+    Lease writer() {
+        std::unique_lock<std::mutex> lock(poolMutex);
+        released.wait(lock, [this] { return !writerLeased; });
+        writerLeased = true;
+        return Lease(this, writerConnection.get());
+    }
+
+    Lease reader() {
+        std::unique_lock<std::mutex> lock(poolMutex);
+        released.wait(lock, [this] { return !idleReaders.empty(); });
+        PooledConnection* connection = idleReaders.back();
+        idleReaders.pop_back();
+        return Lease(this, connection);
+    }
+
+private:
+    std::mutex poolMutex;
+    std::condition_variable released;
+    std::unique_ptr<PooledConnection> writerConnection;
+    bool writerLeased = false;
+    std::vector<std::unique_ptr<PooledConnection>> readers;
+    std::vector<PooledConnection*> idleReaders;
+
+    // The writer opens first so the file, the schema and WAL mode exist before any reader
+    explicit ConnectionPool(const std::string& dbName) {
+        writerConnection = std::make_unique<PooledConnection>(dbName, false);
+        if (sqlite3_exec(writerConnection->handle(), SCHEMA_SQL, nullptr, nullptr, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Could not create schema");
+        }
+        for (int i = 0; i < READER_CONNECTIONS; ++i) {
+            readers.push_back(std::make_unique<PooledConnection>(dbName, true));
+            idleReaders.push_back(readers.back().get());
+        }
+    }
+
+    void giveBack(PooledConnection* connection) {
+        {
+            std::lock_guard<std::mutex> guard(poolMutex);
+            if (connection == writerConnection.get()) {
+                writerLeased = false;
+            } else {
+                idleReaders.push_back(connection);
+            }
+        }
+        released.notify_all();
+    }
+};
+
 // Secure database operation
 bool insertDataSecurely(const std::string& dbName, const std::string& name, int age, const std::string& email) {
-    sqlite3* db = nullptr;
-    sqlite3_stmt* stmt = nullptr;
     bool success = false;
 
-    // Open database with secure mode (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)
-    if (sqlite3_open_v2(dbName.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK) {
+    // The pool keeps the connection open and the INSERT prepared between calls
+    ConnectionPool* pool = ConnectionPool::forDatabase(dbName);
+    if (!pool) {
         std::cerr << "Database error: Unable to open database\n";
         return false;
     }
-
-    // Enable Write-Ahead Logging for better concurrency and security
-    sqlite3_exec(db, "PRAGMA journal_mode=WAL;", nullptr, nullptr, nullptr);
+    ConnectionPool::Lease writer = pool->writer();
+    sqlite3* db = writer->handle();
 
     // Use transaction for atomic operations
     if (sqlite3_exec(db, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr) != SQLITE_OK) {
         std::cerr << "Database error: Could not start transaction\n";
-        sqlite3_close(db);
         return false;
     }
 
     try {
-        // Prepare statement with parameterized query
-        const char* insertSQL = "INSERT INTO Users (Name, Age, Email) VALUES (?, ?, ?);";
-        if (sqlite3_prepare_v2(db, insertSQL, -1, &stmt, nullptr) != SQLITE_OK) {
-            throw std::runtime_error("Failed to prepare statement");
-        }
+        // Parameterized query from the connection's statement cache
+        sqlite3_stmt* stmt = writer->prepare(INSERT_USER_SQL);
 
         // Bind parameters with type checking
         if (sqlite3_bind_text(stmt, 1, name.c_str(), name.length(), SQLITE_STATIC) != SQLITE_OK ||
@@ -91,18 +417,1022 @@ bool insertDataSecurely(const std::string& dbName, const std::string& name, int
         std::cerr << "Database error: " << e.what() << "\n";
     }
 
-    // Cleanup resources
-    if (stmt) sqlite3_finalize(stmt);
-    if (db) sqlite3_close(db);
-
     return success;
 }
 
-int main() {
+// Bind one row to INSERT_USER_SQL; Record is UserRecord or UserRowView
+template <typename Record>
+void bindUserRow(sqlite3_stmt* stmt, const Record& record) {
+    if (sqlite3_bind_text(stmt, 1, record.name.data(), record.name.length(), SQLITE_STATIC) != SQLITE_OK ||
+        sqlite3_bind_int(stmt, 2, record.age) != SQLITE_OK ||
+        sqlite3_bind_text(stmt, 3, record.email.data(), record.email.length(), SQLITE_STATIC) != SQLITE_OK) {
+        throw std::runtime_error("Failed to bind parameters");
+    }
+}
+
+// Bulk insert: one connection and one prepared INSERT for all rows, reset between rows,
+// with a COMMIT every commitBatchSize rows. Returns the number of rows committed; on error
+// the open batch is rolled back and earlier batches stay committed.
+// Record is UserRecord or UserRowView; sql is INSERT_USER_SQL or IMPORT_USER_SQL.
+template <typename Record>
+size_t insertBatchSecurely(const std::string& dbName, const Record* records, size_t count,
+                           size_t commitBatchSize = DEFAULT_COMMIT_BATCH_SIZE,
+                           const char* sql = INSERT_USER_SQL) {
+    size_t committed = 0;
+    size_t pending = 0;
+    bool inTransaction = false;
+
+    ConnectionPool* pool = ConnectionPool::forDatabase(dbName);
+    if (!pool) {
+        std::cerr << "Database error: Unable to open database\n";
+        return 0;
+    }
+    ConnectionPool::Lease writer = pool->writer();
+    sqlite3* db = writer->handle();
+    if (commitBatchSize == 0) commitBatchSize = 1;
+    sqlite3_stmt* stmt = nullptr;
+
+    try {
+        stmt = writer->prepare(sql);
+
+        for (size_t i = 0; i < count; ++i) {
+            if (!inTransaction) {
+                if (sqlite3_exec(db, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+                    throw std::runtime_error("Could not start transaction");
+                }
+                inTransaction = true;
+            }
+
+            bindUserRow(stmt, records[i]);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                throw std::runtime_error("Execution failed at row " + std::to_string(i));
+            }
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+
+            if (++pending == commitBatchSize || i + 1 == count) {
+                if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+                    throw std::runtime_error("Could not commit transaction");
+                }
+                inTransaction = false;
+                committed += pending;
+                pending = 0;
+            }
+        }
+    } catch (const std::exception& e) {
+        // The writer goes back to the pool, so leave neither a transaction nor a bound statement open
+        if (stmt) {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+        if (inTransaction) sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        std::cerr << "Database error: " << e.what() << "\n";
+    }
+
+    return committed;
+}
+
+// Write-behind registration queue. Callers push onto a lock-free MPSC stack and get a future;
+// one writer thread takes everything that has arrived, waits up to WRITE_BEHIND_WINDOW_US for more
+// (or until WRITE_BEHIND_MAX_GROUP rows), and commits the group in one fsync'd transaction.
+// Under concurrency N registrations cost one COMMIT instead of N.
+class WriteBehindQueue {
+public:
+    // Observable state; latencies cover BEGIN through the durable COMMIT
+    struct Stats {
+        size_t depth;           // Rows enqueued and not yet resolved
+        uint64_t groups;
+        uint64_t rows;
+        uint64_t failedRows;
+        double meanGroupSize;
+        double meanCommitUs;
+        double maxCommitUs;
+    };
+
+    explicit WriteBehindQueue(const std::string& dbName) : dbName(dbName) {
+        writer = std::thread(&WriteBehindQueue::run, this);
+    }
+
+    // Commits everything still queued before returning
+    ~WriteBehindQueue() {
+        {
+            std::lock_guard<std::mutex> guard(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+
+    WriteBehindQueue(const WriteBehindQueue&) = delete;
+    WriteBehindQueue& operator=(const WriteBehindQueue&) = delete;
+
+    // Resolves to true once the row is durable, false if it could not be inserted
+    std::future<bool> enqueue(UserRecord record) {
+        Pending* pending = new Pending{std::move(record), std::promise<bool>(), nullptr};
+        std::future<bool> result = pending->done.get_future();
+
+        // Counted before it is published, so the writer never subtracts a row depth has not seen
+        size_t queued = depth.fetch_add(1, std::memory_order_relaxed) + 1;
+        pending->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(pending->next, pending, std::memory_order_release,
+                                           std::memory_order_relaxed)) {
+        }
+
+        // Only the push that makes the queue non-empty, or fills a group, has to wake the writer
+        if (pending->next == nullptr || queued == WRITE_BEHIND_MAX_GROUP) {
+            std::lock_guard<std::mutex> guard(wakeMutex);
+            wake.notify_one();
+        }
+        return result;
+    }
+
+    Stats stats() const {
+        uint64_t groupCount = groups.load(std::memory_order_relaxed);
+        uint64_t rowCount = rows.load(std::memory_order_relaxed);
+        return Stats{depth.load(std::memory_order_relaxed), groupCount, rowCount,
+                     failedRows.load(std::memory_order_relaxed),
+                     groupCount ? static_cast<double>(rowCount) / groupCount : 0.0,
+                     groupCount ? static_cast<double>(totalCommitUs.load(std::memory_order_relaxed)) / groupCount : 0.0,
+                     static_cast<double>(maxCommitUs.load(std::memory_order_relaxed))};
+    }
+
+private:
+    struct Pending {
+        UserRecord record;
+        std::promise<bool> done;
+        Pending* next;
+    };
+
+    std::string dbName;
+    std::atomic<Pending*> head{nullptr};
+    std::atomic<size_t> depth{0};
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread writer;
+
+    std::atomic<uint64_t> groups{0};
+    std::atomic<uint64_t> rows{0};
+    std::atomic<uint64_t> failedRows{0};
+    std::atomic<uint64_t> totalCommitUs{0};
+    std::atomic<uint64_t> maxCommitUs{0};
+
+    // Everything pushed so far, oldest first
+    void takeArrivals(std::vector<Pending*>& group) {
+        Pending* taken = head.exchange(nullptr, std::memory_order_acquire);
+        size_t first = group.size();
+        for (; taken; taken = taken->next) group.push_back(taken);
+        std::reverse(group.begin() + first, group.end());
+    }
+
+    void run() {
+        std::vector<Pending*> group;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait(lock, [this] { return stopping || head.load(std::memory_order_acquire) != nullptr; });
+                if (stopping && head.load(std::memory_order_acquire) == nullptr) return;
+
+                // Give concurrent callers a short window to join this group
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(WRITE_BEHIND_WINDOW_US);
+                wake.wait_until(lock, deadline, [this] {
+                    return stopping || depth.load(std::memory_order_relaxed) >= WRITE_BEHIND_MAX_GROUP;
+                });
+            }
+            takeArrivals(group);
+            commitGroup(group);
+            group.clear();
+        }
+    }
+
+    void commitGroup(std::vector<Pending*>& group) {
+        ConnectionPool* pool = ConnectionPool::forDatabase(dbName);
+        std::vector<char> stored(group.size(), 0);
+        auto started = std::chrono::steady_clock::now();
+
+        if (!pool) {
+            std::cerr << "Database error: Unable to open database\n";
+        } else {
+            ConnectionPool::Lease lease = pool->writer();
+            sqlite3* db = lease->handle();
+            // The pool runs synchronous=NORMAL; a resolved future promises the row survives a power loss
+            sqlite3_exec(db, "PRAGMA synchronous=FULL;", nullptr, nullptr, nullptr);
+            if (insertRows(lease, group.data(), group.size())) {
+                std::fill(stored.begin(), stored.end(), 1);
+            } else {
+                // One bad row must not fail its neighbours: retry each on its own
+                for (size_t i = 0; i < group.size(); ++i) stored[i] = insertRows(lease, &group[i], 1);
+            }
+            sqlite3_exec(db, "PRAGMA synchronous=NORMAL;", nullptr, nullptr, nullptr);
+        }
+
+        uint64_t commitUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        groups.fetch_add(1, std::memory_order_relaxed);
+        rows.fetch_add(group.size(), std::memory_order_relaxed);
+        totalCommitUs.fetch_add(commitUs, std::memory_order_relaxed);
+        if (commitUs > maxCommitUs.load(std::memory_order_relaxed)) maxCommitUs.store(commitUs, std::memory_order_relaxed);
+
+        for (size_t i = 0; i < group.size(); ++i) {
+            if (!stored[i]) failedRows.fetch_add(1, std::memory_order_relaxed);
+            group[i]->done.set_value(stored[i]);
+            delete group[i];
+        }
+        depth.fetch_sub(group.size(), std::memory_order_relaxed);
+    }
+
+    static bool insertRows(ConnectionPool::Lease& lease, Pending* const* group, size_t count) {
+        sqlite3* db = lease->handle();
+        if (sqlite3_exec(db, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+            std::cerr << "Database error: Could not start transaction\n";
+            return false;
+        }
+        try {
+            sqlite3_stmt* stmt = lease->prepare(INSERT_USER_SQL);
+            for (size_t i = 0; i < count; ++i) {
+                bindUserRow(stmt, group[i]->record);
+                if (sqlite3_step(stmt) != SQLITE_DONE) {
+                    throw std::runtime_error("Execution failed");
+                }
+                sqlite3_reset(stmt);
+                sqlite3_clear_bindings(stmt);
+            }
+            if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+                throw std::runtime_error("Could not commit transaction");
+            }
+            return true;
+        } catch (const std::exception& e) {
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+            std::cerr << "Database error: " << e.what() << "\n";
+            return false;
+        }
+    }
+};
+
+// One stored user as returned by the read API
+struct UserRow {
+    sqlite3_int64 id;
+    std::string name;
+    int age;
+    std::string email;
+};
+
+// Position in an age-ordered scan: the (Age, ID) of the last row handed out.
+// A default cursor starts before the first row; done is set once the range is exhausted.
+struct AgePageCursor {
+    int age = std::numeric_limits<int>::min();
+    sqlite3_int64 id = 0;
+    bool done = false;
+};
+
+void readUserRow(sqlite3_stmt* stmt, UserRow& row) {
+    row.id = sqlite3_column_int64(stmt, 0);
+    row.name.assign(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)), sqlite3_column_bytes(stmt, 1));
+    row.age = sqlite3_column_int(stmt, 2);
+    row.email.assign(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)), sqlite3_column_bytes(stmt, 3));
+}
+
+// Single-row lookup on a pooled read-only connection. Returns true and fills row when a user
+// matches; false when none does or on error (reported on stderr).
+bool findUser(const std::string& dbName, const char* sql, const std::function<bool(sqlite3_stmt*)>& bindKey,
+              UserRow& row) {
+    ConnectionPool* pool = ConnectionPool::forDatabase(dbName);
+    if (!pool) {
+        std::cerr << "Database error: Unable to open database\n";
+        return false;
+    }
+    ConnectionPool::Lease reader = pool->reader();
+    try {
+        sqlite3_stmt* stmt = reader->prepare(sql);
+        if (!bindKey(stmt)) {
+            throw std::runtime_error("Failed to bind parameters");
+        }
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW) {
+            readUserRow(stmt, row);
+            sqlite3_reset(stmt);
+            return true;
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE) {
+            throw std::runtime_error("Execution failed");
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Database error: " << e.what() << "\n";
+    }
+    return false;
+}
+
+// Point lookup through the unique email index
+bool findUserByEmail(const std::string& dbName, std::string_view email, UserRow& row) {
+    return findUser(dbName, FIND_USER_BY_EMAIL_SQL, [&](sqlite3_stmt* stmt) {
+        return sqlite3_bind_text(stmt, 1, email.data(), email.length(), SQLITE_STATIC) == SQLITE_OK;
+    }, row);
+}
+
+// Point lookup on the rowid
+bool findUserById(const std::string& dbName, sqlite3_int64 id, UserRow& row) {
+    return findUser(dbName, FIND_USER_BY_ID_SQL, [&](sqlite3_stmt* stmt) {
+        return sqlite3_bind_int64(stmt, 1, id) == SQLITE_OK;
+    }, row);
+}
+
+// Next page of users with minAge <= Age <= maxAge in (Age, ID) order, resuming after cursor.
+// Keyset pagination: each page is a seek on the age index rather than an OFFSET walk, so page
+// N costs the same as page 1 and rows inserted meanwhile never shift a page boundary.
+// page is overwritten (its strings are reused); returns false on error.
+bool listUsersByAge(const std::string& dbName, int minAge, int maxAge, AgePageCursor& cursor,
+                    size_t pageSize, std::vector<UserRow>& page) {
+    size_t filled = 0;
+    ConnectionPool* pool = ConnectionPool::forDatabase(dbName);
+    if (!pool) {
+        std::cerr << "Database error: Unable to open database\n";
+        return false;
+    }
+    if (cursor.age < minAge) {
+        cursor.age = minAge;
+        cursor.id = std::numeric_limits<sqlite3_int64>::min();
+    }
+
+    ConnectionPool::Lease reader = pool->reader();
+    // Both statements bind (age, second key, remaining rows) and append to the page
+    auto fetch = [&](const char* sql, sqlite3_int64 secondKey) {
+        sqlite3_stmt* stmt = reader->prepare(sql);
+        if (sqlite3_bind_int(stmt, 1, cursor.age) != SQLITE_OK ||
+            sqlite3_bind_int64(stmt, 2, secondKey) != SQLITE_OK ||
+            sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(pageSize - filled)) != SQLITE_OK) {
+            throw std::runtime_error("Failed to bind parameters");
+        }
+
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            if (filled == page.size()) page.emplace_back();
+            readUserRow(stmt, page[filled++]);
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE) {
+            throw std::runtime_error("Execution failed");
+        }
+    };
+
+    try {
+        if (cursor.age <= maxAge) fetch(LIST_USERS_SAME_AGE_SQL, cursor.id);
+        if (filled < pageSize) fetch(LIST_USERS_LATER_AGES_SQL, maxAge);
+    } catch (const std::exception& e) {
+        std::cerr << "Database error: " << e.what() << "\n";
+        page.resize(filled);
+        return false;
+    }
+
+    page.resize(filled);
+    if (filled > 0) {
+        cursor.age = page.back().age;
+        cursor.id = page.back().id;
+    }
+    cursor.done = filled < pageSize;
+    return true;
+}
+
+// Blocking FIFO with a fixed capacity; close() wakes everyone once no more items will come
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        notFull.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+    }
+
+    // False once the queue is closed and drained
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> guard(queueMutex);
+        closed = true;
+        notEmpty.notify_all();
+    }
+
+private:
+    std::mutex queueMutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+};
+
+// A line-aligned slice of the input, parsed and validated by one worker.
+// Passed between stages by pointer: rows may point into the arena, so the chunk itself never moves.
+struct ImportChunk {
+    size_t offset;
+    size_t length;
+    std::vector<UserRowView> rows;
+    std::string arena;         // Unescaped field text; reserved to length so it never reallocates
+    size_t rejected = 0;
+};
+
+// Decode a CSV field in place; quoted fields with "" escapes are unescaped into the arena
+std::string_view csvField(std::string_view line, size_t& pos, std::string& arena) {
+    if (pos < line.size() && line[pos] == '"') {
+        size_t start = ++pos;
+        bool escaped = false;
+        while (pos < line.size()) {
+            if (line[pos] == '"') {
+                if (pos + 1 < line.size() && line[pos + 1] == '"') {
+                    escaped = true;
+                    pos += 2;
+                    continue;
+                }
+                break;
+            }
+            ++pos;
+        }
+        std::string_view raw = line.substr(start, pos - start);
+        pos = std::min(line.size(), pos + 1); // Closing quote
+        if (pos < line.size() && line[pos] == ',') ++pos;
+        if (!escaped) return raw;
+
+        size_t begin = arena.size();
+        for (size_t i = 0; i < raw.size(); ++i) {
+            arena += raw[i];
+            if (raw[i] == '"') ++i; // Second quote of the pair
+        }
+        return std::string_view(arena.data() + begin, arena.size() - begin);
+    }
+
+    size_t start = pos;
+    while (pos < line.size() && line[pos] != ',') ++pos;
+    std::string_view field = line.substr(start, pos - start);
+    if (pos < line.size()) ++pos;
+    return field;
+}
+
+// Column positions of name, age and email; taken from a header row when the file has one
+struct CsvLayout {
+    int name = 0;
+    int age = 1;
+    int email = 2;
+    bool header = false;
+};
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+        return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+CsvLayout detectCsvLayout(std::string_view firstLine) {
+    CsvLayout layout;
+    CsvLayout named;
+    named.name = named.age = named.email = -1;
+    std::string scratch;
+    size_t pos = 0;
+    for (int column = 0; pos < firstLine.size(); ++column) {
+        std::string_view field = csvField(firstLine, pos, scratch);
+        if (equalsIgnoreCase(field, "name")) named.name = column;
+        if (equalsIgnoreCase(field, "age")) named.age = column;
+        if (equalsIgnoreCase(field, "email")) named.email = column;
+    }
+    if (named.name >= 0 && named.age >= 0 && named.email >= 0) {
+        layout = named;
+        layout.header = true;
+    }
+    return layout;
+}
+
+bool parseCsvRow(std::string_view line, const CsvLayout& layout, std::string& arena,
+                 std::string_view& name, std::string_view& age, std::string_view& email) {
+    size_t pos = 0;
+    int found = 0;
+    for (int column = 0; found < 3; ++column) {
+        std::string_view field = csvField(line, pos, arena);
+        if (column == layout.name) name = field, ++found;
+        if (column == layout.age) age = field, ++found;
+        if (column == layout.email) email = field, ++found;
+        if (pos >= line.size()) break;
+    }
+    return found == 3;
+}
+
+// Append the UTF-8 encoding of a code point to the arena
+void appendUtf8(std::string& arena, unsigned long codePoint) {
+    if (codePoint < 0x80) {
+        arena += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        arena += static_cast<char>(0xC0 | (codePoint >> 6));
+        arena += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        arena += static_cast<char>(0xE0 | (codePoint >> 12));
+        arena += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        arena += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        arena += static_cast<char>(0xF0 | (codePoint >> 18));
+        arena += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        arena += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        arena += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+// JSON string starting at the opening quote; escapes are decoded into the arena
+bool jsonString(std::string_view line, size_t& pos, std::string& arena, std::string_view& value) {
+    size_t start = ++pos;
+    while (pos < line.size() && line[pos] != '"' && line[pos] != '\\') ++pos;
+    if (pos < line.size() && line[pos] == '"') {
+        value = line.substr(start, pos++ - start);
+        return true;
+    }
+
+    size_t begin = arena.size();
+    arena.append(line.data() + start, pos - start);
+    while (pos < line.size() && line[pos] != '"') {
+        char c = line[pos++];
+        if (c != '\\') {
+            arena += c;
+            continue;
+        }
+        if (pos >= line.size()) return false;
+        char escape = line[pos++];
+        switch (escape) {
+            case '"': case '\\': case '/': arena += escape; break;
+            case 'b': arena += '\b'; break;
+            case 'f': arena += '\f'; break;
+            case 'n': arena += '\n'; break;
+            case 'r': arena += '\r'; break;
+            case 't': arena += '\t'; break;
+            case 'u': {
+                unsigned long codePoint = 0;
+                if (pos + 4 > line.size() || std::from_chars(line.data() + pos, line.data() + pos + 4, codePoint, 16).ptr != line.data() + pos + 4) return false;
+                pos += 4;
+                // A high surrogate must be followed by its low half
+                if (codePoint >= 0xD800 && codePoint < 0xDC00) {
+                    unsigned long low = 0;
+                    if (pos + 6 > line.size() || line[pos] != '\\' || line[pos + 1] != 'u' ||
+                        std::from_chars(line.data() + pos + 2, line.data() + pos + 6, low, 16).ptr != line.data() + pos + 6 ||
+                        low < 0xDC00 || low > 0xDFFF) return false;
+                    pos += 6;
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(arena, codePoint);
+                break;
+            }
+            default: return false;
+        }
+    }
+    if (pos >= line.size()) return false;
+    ++pos;
+    value = std::string_view(arena.data() + begin, arena.size() - begin);
+    return true;
+}
+
+// One flat NDJSON object; keys other than name, age and email are skipped
+bool parseJsonRow(std::string_view line, std::string& arena,
+                  std::string_view& name, std::string_view& age, std::string_view& email) {
+    auto skipSpace = [&](size_t& pos) {
+        while (pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos]))) ++pos;
+    };
+    size_t pos = 0;
+    skipSpace(pos);
+    if (pos >= line.size() || line[pos++] != '{') return false;
+
+    int found = 0;
+    while (true) {
+        skipSpace(pos);
+        if (pos < line.size() && line[pos] == '}') break;
+        std::string_view key, value;
+        if (pos >= line.size() || line[pos] != '"' || !jsonString(line, pos, arena, key)) return false;
+        skipSpace(pos);
+        if (pos >= line.size() || line[pos++] != ':') return false;
+        skipSpace(pos);
+
+        if (pos < line.size() && line[pos] == '"') {
+            if (!jsonString(line, pos, arena, value)) return false;
+        } else {
+            size_t start = pos;
+            while (pos < line.size() && line[pos] != ',' && line[pos] != '}' &&
+                   !std::isspace(static_cast<unsigned char>(line[pos]))) ++pos;
+            value = line.substr(start, pos - start); // Number or literal
+        }
+        if (equalsIgnoreCase(key, "name")) name = value, ++found;
+        else if (equalsIgnoreCase(key, "age")) age = value, ++found;
+        else if (equalsIgnoreCase(key, "email")) email = value, ++found;
+
+        skipSpace(pos);
+        if (pos < line.size() && line[pos] == ',') {
+            ++pos;
+            continue;
+        }
+        if (pos < line.size() && line[pos] == '}') break;
+        return false;
+    }
+    return found == 3;
+}
+
+// Parse and validate every line of a chunk; rows point into the mapping or the chunk's arena
+void parseChunk(const char* data, ImportChunk& chunk, bool ndjson, const CsvLayout& layout) {
+    chunk.arena.reserve(chunk.length);
+    std::string_view text(data + chunk.offset, chunk.length);
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string_view::npos) end = text.size();
+        std::string_view line = text.substr(pos, end - pos);
+        pos = end + 1;
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty()) continue;
+
+        std::string_view name, ageText, email;
+        bool parsed = ndjson ? parseJsonRow(line, chunk.arena, name, ageText, email)
+                             : parseCsvRow(line, layout, chunk.arena, name, ageText, email);
+        int age = 0;
+        if (!parsed ||
+            std::from_chars(ageText.data(), ageText.data() + ageText.size(), age).ptr != ageText.data() + ageText.size() ||
+            ageText.empty() || age < MIN_AGE || age > MAX_AGE ||
+            name.empty() || name.length() > static_cast<size_t>(MAX_NAME_LENGTH) || !isValidEmail(email)) {
+            static std::atomic<size_t> reported{0};
+            ++chunk.rejected;
+            if (reported++ < IMPORT_REJECT_REPORT_LIMIT) {
+                std::cerr << "Rejected row at byte " << chunk.offset + (line.data() - text.data()) << "\n";
+            }
+            continue;
+        }
+        chunk.rows.push_back(UserRowView{name, age, email});
+    }
+}
+
+// Bulk import of a CSV (name,age,email, optional header) or NDJSON export into Users.
+// The file is mapped and cut into line-aligned chunks; workers validate chunks in parallel
+// and a single writer inserts them in batches. At most IMPORT_QUEUE_DEPTH chunks per queue are
+// resident, and pages are dropped once written, so memory stays flat for any input size.
+// Rows whose email is already registered are skipped and still count as imported.
+int importUsers(const std::string& dbName, const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat fileInfo;
+    if (fd < 0 || fstat(fd, &fileInfo) != 0) {
+        std::cerr << "Import error: Unable to open " << path << "\n";
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    size_t size = fileInfo.st_size;
+    if (size == 0) {
+        close(fd);
+        std::cout << "Imported 0 rows\n";
+        return 0;
+    }
+    const char* data = static_cast<const char*>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "Import error: Unable to map " << path << "\n";
+        return 1;
+    }
+    madvise(const_cast<char*>(data), size, MADV_SEQUENTIAL);
+
+    // NDJSON rows are objects; anything else is read as CSV
+    size_t firstContent = 0;
+    while (firstContent < size && std::isspace(static_cast<unsigned char>(data[firstContent]))) ++firstContent;
+    bool ndjson = firstContent < size && data[firstContent] == '{';
+    size_t start = 0;
+    CsvLayout layout;
+    if (!ndjson) {
+        const char* newline = static_cast<const char*>(memchr(data, '\n', size));
+        size_t firstLength = newline ? newline - data : size;
+        std::string_view firstLine(data, firstLength);
+        if (!firstLine.empty() && firstLine.back() == '\r') firstLine.remove_suffix(1);
+        layout = detectCsvLayout(firstLine);
+        if (layout.header) start = newline ? firstLength + 1 : size;
+    }
+
+    ConnectionPool* pool = ConnectionPool::forDatabase(dbName);
+    if (!pool) {
+        std::cerr << "Database error: Unable to open database\n";
+        munmap(const_cast<char*>(data), size);
+        return 1;
+    }
+
+    BoundedQueue<std::unique_ptr<ImportChunk>> parseQueue(IMPORT_QUEUE_DEPTH);
+    BoundedQueue<std::unique_ptr<ImportChunk>> writeQueue(IMPORT_QUEUE_DEPTH);
+    std::atomic<bool> failed{false};
+    size_t imported = 0;
+    size_t rejected = 0;
+    size_t bytesDone = 0;
+    auto started = std::chrono::steady_clock::now();
+
+    // One core is left for the writer; hardware_concurrency() may report 0 when unknown
+    unsigned int cores = std::thread::hardware_concurrency();
+    unsigned int workerCount = cores > 1 ? cores - 1 : 1;
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < workerCount; ++i) {
+        workers.emplace_back([&] {
+            std::unique_ptr<ImportChunk> chunk;
+            while (parseQueue.pop(chunk)) {
+                parseChunk(data, *chunk, ndjson, layout);
+                writeQueue.push(std::move(chunk));
+            }
+        });
+    }
+
+    std::thread writer([&] {
+        long pageSize = sysconf(_SC_PAGESIZE);
+        auto lastReport = started;
+        std::unique_ptr<ImportChunk> chunk;
+        while (writeQueue.pop(chunk)) { // Chunks arrive in the order workers finish them
+            if (!failed && !chunk->rows.empty() &&
+                insertBatchSecurely(dbName, chunk->rows.data(), chunk->rows.size(),
+                                    DEFAULT_COMMIT_BATCH_SIZE, IMPORT_USER_SQL) != chunk->rows.size()) {
+                failed = true; // Batches before the failure stay committed
+            }
+            imported += failed ? 0 : chunk->rows.size();
+            rejected += chunk->rejected;
+            bytesDone += chunk->length;
+
+            // Whole pages inside the chunk are not needed again; neighbours re-fault theirs if still in use
+            size_t first = (chunk->offset + pageSize - 1) / pageSize * pageSize;
+            size_t last = (chunk->offset + chunk->length) / pageSize * pageSize;
+            if (last > first) madvise(const_cast<char*>(data) + first, last - first, MADV_DONTNEED);
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastReport >= std::chrono::seconds(IMPORT_PROGRESS_INTERVAL_S)) {
+                double seconds = std::chrono::duration<double>(now - started).count();
+                std::cerr << "Progress: " << imported << " rows (" << static_cast<long>(imported / seconds)
+                          << " rows/s), " << rejected << " rejected, "
+                          << static_cast<int>(100.0 * (bytesDone + start) / size) << "% of input\n";
+                lastReport = now;
+            }
+        }
+    });
+
+    // Cut line-aligned chunks; the queues bound how far reading runs ahead of writing
+    for (size_t offset = start; offset < size && !failed; ) {
+        size_t end = std::min(size, offset + IMPORT_CHUNK_BYTES);
+        if (end < size) {
+            const char* newline = static_cast<const char*>(memchr(data + end, '\n', size - end));
+            end = newline ? newline - data + 1 : size;
+        }
+        std::unique_ptr<ImportChunk> chunk(new ImportChunk());
+        chunk->offset = offset;
+        chunk->length = end - offset;
+        parseQueue.push(std::move(chunk));
+        offset = end;
+    }
+    parseQueue.close();
+    for (auto& worker : workers) worker.join();
+    writeQueue.close();
+    writer.join();
+    munmap(const_cast<char*>(data), size);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "Imported " << imported << " rows in " << seconds << " s ("
+              << static_cast<long>(imported / std::max(seconds, 1e-9)) << " rows/s), " << rejected << " rejected\n";
+    if (failed) {
+        std::cerr << "Import stopped after a database error\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Differential check of the DFA against the regex, then the per-address cost of each.
+// Every string up to EMAIL_CHECK_EXHAUSTIVE_LENGTH over one representative per character class
+// is compared, followed by randomCount mutated addresses.
+int checkEmailValidator(size_t randomCount) {
+    const std::string representatives = "aZ7-.@_#\xc3";
+    size_t compared = 0;
+    size_t mismatches = 0;
+    auto compare = [&](const std::string& email) {
+        ++compared;
+        if (isValidEmail(email) != isValidEmailRegex(email) && mismatches++ < 10) {
+            std::cerr << "Mismatch: \"" << email << "\" dfa=" << isValidEmail(email) << "\n";
+        }
+    };
+
+    std::string email;
+    std::vector<size_t> digits;
+    for (int length = 0; length <= EMAIL_CHECK_EXHAUSTIVE_LENGTH; ++length) {
+        digits.assign(length, 0);
+        while (true) {
+            email.clear();
+            for (size_t digit : digits) email += representatives[digit];
+            compare(email);
+            int position = length - 1;
+            while (position >= 0 && ++digits[position] == representatives.size()) digits[position--] = 0;
+            if (position < 0) break;
+        }
+    }
+
+    // Plausible addresses with random damage, plus a few near the length limit
+    std::mt19937_64 random(12345);
+    const std::string alphabet = "abcxyzABCXYZ0189._%+-@#!\xc3\xa9";
+    std::vector<std::string> corpus;
+    for (size_t i = 0; i < randomCount; ++i) {
+        std::string candidate = "user" + std::to_string(random() % 100000) + "@mail" +
+                                std::to_string(random() % 100) + ".example." + (random() % 2 ? "com" : "io");
+        for (int edits = random() % 4; edits > 0; --edits) {
+            size_t at = random() % (candidate.size() + 1);
+            char c = alphabet[random() % alphabet.size()];
+            switch (random() % 3) {
+                case 0: candidate.insert(candidate.begin() + at, c); break;
+                case 1: if (at < candidate.size()) candidate.erase(at, 1); break;
+                default: if (at < candidate.size()) candidate[at] = c; break;
+            }
+        }
+        if (i % 1000 == 0) candidate = std::string(MAX_EMAIL_LENGTH - 7 + random() % 3, 'a') + "@b.com";
+        compare(candidate);
+        corpus.push_back(candidate);
+    }
+    std::cout << "Compared " << compared << " strings, " << mismatches << " mismatches\n";
+
+    // Per-address cost over the random corpus
+    std::vector<std::string_view> views(corpus.begin(), corpus.end());
+    std::unique_ptr<bool[]> results(new bool[views.size()]);
+    auto timeNs = [&](const std::function<size_t()>& run) {
+        auto start = std::chrono::steady_clock::now();
+        size_t accepted = run();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return std::make_pair(ns / views.size(), accepted);
+    };
+    auto regex = timeNs([&] { size_t n = 0; for (auto v : views) n += isValidEmailRegex(v); return n; });
+    auto dfa = timeNs([&] { size_t n = 0; for (auto v : views) n += isValidEmail(v); return n; });
+    auto batch = timeNs([&] { return validateEmails(views.data(), views.size(), results.get()); });
+    std::cout << "Per address: regex " << regex.first << " ns, dfa " << dfa.first << " ns, batch "
+              << batch.first << " ns (" << dfa.second << " of " << views.size() << " valid)\n";
+    return mismatches == 0 && regex.second == dfa.second && dfa.second == batch.second ? 0 : 1;
+}
+
+// Read path benchmark on a synthetic table of at least `rows` users: email and ID lookup
+// latency from READER_CONNECTIONS threads while a writer keeps inserting, then a keyset scan
+// over an age range. Missing rows are generated first, so later runs reuse the table.
+int benchmarkReads(const std::string& dbName, size_t rows) {
+    ConnectionPool* pool = ConnectionPool::forDatabase(dbName);
+    if (!pool) {
+        std::cerr << "Database error: Unable to open database\n";
+        return 1;
+    }
+    auto syntheticUser = [](size_t i) {
+        return UserRecord{"User " + std::to_string(i), MIN_AGE + static_cast<int>(i * 7919 % (MAX_AGE - MIN_AGE + 1)),
+                          "user" + std::to_string(i) + "@example.com"};
+    };
+
+    // Rows the concurrent writer adds are removed after each phase (and here, should a run have
+    // been interrupted), so the table only ever holds synthetic users with IDs 1..present
+    auto removeWriterRows = [&] {
+        ConnectionPool::Lease writer = pool->writer();
+        if (sqlite3_exec(writer->handle(), READ_BENCH_REMOVE_WRITER_ROWS_SQL, nullptr, nullptr, nullptr) != SQLITE_OK) {
+            std::cerr << "Database error: " << sqlite3_errmsg(writer->handle()) << "\n";
+            return false;
+        }
+        return true;
+    };
+    if (!removeWriterRows()) return 1;
+
+    sqlite3_int64 present = 0;
+    sqlite3_int64 highestId = 0;
+    {
+        ConnectionPool::Lease reader = pool->reader();
+        sqlite3_stmt* stmt = reader->prepare("SELECT COUNT(*), COALESCE(MAX(ID), 0) FROM Users;");
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            present = sqlite3_column_int64(stmt, 0);
+            highestId = sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_reset(stmt);
+    }
+    if (present != highestId) {
+        std::cout << dbName << " has gaps in its IDs; regenerating\n";
+        ConnectionPool::Lease writer = pool->writer();
+        if (sqlite3_exec(writer->handle(), "DELETE FROM Users;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+            std::cerr << "Database error: " << sqlite3_errmsg(writer->handle()) << "\n";
+            return 1;
+        }
+        present = 0;
+    }
+    if (static_cast<size_t>(present) < rows) {
+        std::cout << "Generating " << rows - present << " rows...\n";
+        auto started = std::chrono::steady_clock::now();
+        std::vector<UserRecord> block;
+        for (size_t next = present + 1; next <= rows; ) {
+            block.clear();
+            for (; next <= rows && block.size() < DEFAULT_COMMIT_BATCH_SIZE * 10; ++next) {
+                block.push_back(syntheticUser(next));
+            }
+            if (insertBatchSecurely(dbName, block.data(), block.size(), DEFAULT_COMMIT_BATCH_SIZE,
+                                    IMPORT_USER_SQL) != block.size()) {
+                return 1;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::cout << "Generated in " << seconds << " s\n";
+        present = rows;
+    }
+
+    // Lookups of existing users, timed one by one, while a writer commits alongside
+    auto percentile = [](std::vector<double>& samples, double fraction) {
+        size_t at = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+        std::nth_element(samples.begin(), samples.begin() + at, samples.end());
+        return samples[at];
+    };
+    auto timeLookups = [&](const char* label, const std::function<bool(std::mt19937_64&, UserRow&)>& lookup) {
+        std::atomic<bool> reading{true};
+        std::atomic<size_t> written{0};
+        std::thread writer([&] {
+            size_t batch = 0;
+            std::vector<UserRecord> records;
+            while (reading) {
+                records.clear();
+                for (size_t i = 0; i < 100; ++i) {
+                    records.push_back(UserRecord{"Writer", 30, READ_BENCH_WRITER_EMAIL_PREFIX + label + "_" +
+                                                               std::to_string(batch) + "_" + std::to_string(i) +
+                                                               "@example.com"});
+                }
+                written += insertBatchSecurely(dbName, records.data(), records.size());
+                ++batch;
+            }
+        });
+
+        std::vector<std::vector<double>> latencies(READER_CONNECTIONS);
+        std::atomic<size_t> misses{0};
+        auto started = std::chrono::steady_clock::now();
+        std::vector<std::thread> readers;
+        for (int t = 0; t < READER_CONNECTIONS; ++t) {
+            readers.emplace_back([&, t] {
+                std::mt19937_64 random(t + 1);
+                UserRow row;
+                for (size_t i = t; i < READ_BENCH_LOOKUPS; i += READER_CONNECTIONS) {
+                    auto start = std::chrono::steady_clock::now();
+                    if (!lookup(random, row)) ++misses;
+                    latencies[t].push_back(std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - start).count());
+                }
+            });
+        }
+        for (auto& reader : readers) reader.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        reading = false;
+        writer.join();
+        if (!removeWriterRows()) return false;
+
+        std::vector<double> all;
+        for (auto& samples : latencies) all.insert(all.end(), samples.begin(), samples.end());
+        std::cout << label << " lookups: " << static_cast<long>(all.size() / seconds) << " /s, p50 "
+                  << percentile(all, 0.50) << " us, p99 " << percentile(all, 0.99) << " us, "
+                  << misses << " misses; writer committed " << written << " rows alongside ("
+                  << static_cast<long>(written / seconds) << " rows/s)\n";
+        return misses == 0;
+    };
+
+    bool ok = timeLookups("Email", [&](std::mt19937_64& random, UserRow& row) {
+        std::string email = "user" + std::to_string(random() % rows + 1) + "@example.com";
+        return findUserByEmail(dbName, email, row) && row.email == email;
+    });
+    ok = timeLookups("ID", [&](std::mt19937_64& random, UserRow& row) {
+        sqlite3_int64 id = random() % present + 1;
+        return findUserById(dbName, id, row) && row.id == id;
+    }) && ok;
+
+    // Keyset scan; the first and last pages should cost the same
+    AgePageCursor cursor;
+    std::vector<UserRow> page;
+    std::vector<double> pageUs;
+    size_t scanned = 0;
+    auto started = std::chrono::steady_clock::now();
+    while (!cursor.done) {
+        auto start = std::chrono::steady_clock::now();
+        if (!listUsersByAge(dbName, READ_BENCH_SCAN_MIN_AGE, READ_BENCH_SCAN_MAX_AGE, cursor,
+                            READ_BENCH_PAGE_SIZE, page)) {
+            return 1;
+        }
+        pageUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        scanned += page.size();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "Age " << READ_BENCH_SCAN_MIN_AGE << "-" << READ_BENCH_SCAN_MAX_AGE << " scan: " << scanned
+              << " rows in " << pageUs.size() << " pages, " << static_cast<long>(scanned / seconds)
+              << " rows/s; first page " << pageUs.front() << " us, last full page "
+              << pageUs[pageUs.size() > 1 ? pageUs.size() - 2 : 0] << " us\n";
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
     // Secure database file configuration
     const std::string dbName = "secure_user_db.db";
     const int DB_FILE_PERMISSIONS = 0600; // Read/write for owner only
 
+    // "--import FILE" loads a CSV or NDJSON export instead of registering interactively
+    if (argc == 3 && std::string(argv[1]) == "--import") return importUsers(dbName, argv[2]);
+    // "--check-email" compares the email DFA with the regex and times both
+    if (argc == 2 && std::string(argv[1]) == "--check-email") return checkEmailValidator(EMAIL_CHECK_RANDOM_COUNT);
+    // "--bench-read [ROWS]" times lookups and paginated scans on a synthetic table in READ_BENCH_DB
+    if ((argc == 2 || argc == 3) && std::string(argv[1]) == "--bench-read") {
+        return benchmarkReads(READ_BENCH_DB, argc == 3 ? std::stoul(argv[2]) : READ_BENCH_ROWS);
+    }
+
     // Get validated user input
     std::string name, email;
     int age;
@@ -131,8 +1461,10 @@ int main() {
         }
     } while (!isValidEmail(email));
 
-    // Insert data with error handling
-    if (insertDataSecurely(dbName, name, age, email)) {
+    // Insert data with error handling; the queue resolves once the row is durable
+    WriteBehindQueue registrations(dbName);
+    std::future<bool> stored = registrations.enqueue(UserRecord{name, age, email});
+    if (stored.get()) {
         std::cout << "Registration successful!\n";
     } else {
         std::cerr << "Registration failed. Please try again later.\n";
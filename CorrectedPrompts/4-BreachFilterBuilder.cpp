@@ -0,0 +1,258 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+
+// Offline builder for the breach filter read by 4-UserPasword-Corrected.cpp.
+// Input is one entry per line: either a plaintext password or an HIBP-style SHA-1
+// ("40 hex digits", optionally followed by ":count"). The output is a blocked Bloom filter:
+// a 64-byte header, then 512-bit blocks; each key sets up to ten bits inside one block.
+//
+//   4-BreachFilterBuilder INPUT OUTPUT [BITS_PER_KEY]
+//
+// Afterwards the false-positive rate is reported, both as predicted from the block fill and
+// as measured on probes that are not in the corpus.
+
+constexpr double DEFAULT_BITS_PER_KEY = 16;
+constexpr size_t BLOCK_BYTES = 64;
+constexpr uint32_t BLOCK_BITS = BLOCK_BYTES * 8;
+constexpr uint32_t MAX_HASHES_PER_KEY = 10;
+constexpr size_t FPR_PROBE_COUNT = 2000000;
+constexpr char FILTER_MAGIC[8] = {'P', 'W', 'B', 'L', 'O', 'O', 'M', '1'};
+
+// Must match BreachFilter in 4-UserPasword-Corrected.cpp
+struct Header {
+    char magic[8];
+    uint64_t blockCount;
+    uint64_t keyCount;
+    uint32_t hashesPerKey;
+    uint32_t reserved;
+    uint8_t padding[32];    // Blocks start on a cache line
+};
+static_assert(sizeof(Header) == BLOCK_BYTES, "header must keep blocks cache-line aligned");
+
+// SHA-1 with a context reused across calls on this thread
+bool sha1(std::string_view text, unsigned char* digest) {
+    static EVP_MD* algorithm = EVP_MD_fetch(nullptr, "SHA1", nullptr);
+    thread_local std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> context(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    return algorithm && context && EVP_DigestInit_ex2(context.get(), algorithm, nullptr) == 1 &&
+           EVP_DigestUpdate(context.get(), text.data(), text.size()) == 1 &&
+           EVP_DigestFinal_ex(context.get(), digest, nullptr) == 1;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Digest for one input line: decoded when it is an HIBP hash, hashed when it is a plaintext
+bool lineDigest(std::string_view line, unsigned char* digest) {
+    if (line.size() >= 40 && (line.size() == 40 || line[40] == ':')) {
+        bool isHash = true;
+        for (size_t i = 0; i < 20 && isHash; ++i) {
+            int high = hexValue(line[2 * i]);
+            int low = hexValue(line[2 * i + 1]);
+            isHash = high >= 0 && low >= 0;
+            digest[i] = static_cast<unsigned char>(high << 4 | low);
+        }
+        if (isHash) return true;
+    }
+    return sha1(line, digest);
+}
+
+// Block index and in-block bit positions, exactly as BreachFilter::contains() computes them
+struct Probe {
+    uint64_t block;
+    uint32_t bits[MAX_HASHES_PER_KEY];
+};
+
+Probe probeFor(const unsigned char* digest, uint64_t blockCount, uint32_t hashesPerKey) {
+    uint64_t selector, positions;
+    uint32_t morePositions;
+    std::memcpy(&selector, digest, sizeof(selector));
+    std::memcpy(&positions, digest + 8, sizeof(positions));
+    std::memcpy(&morePositions, digest + 16, sizeof(morePositions));
+
+    Probe probe{};
+    probe.block = static_cast<uint64_t>((static_cast<unsigned __int128>(selector) * blockCount) >> 64);
+    for (uint32_t i = 0; i < hashesPerKey; ++i) {
+        probe.bits[i] = (i < 7 ? positions >> (9 * i) : morePositions >> (9 * (i - 7))) & (BLOCK_BITS - 1);
+    }
+    return probe;
+}
+
+// Calls visit(line) for each non-empty line in [begin, end), without a trailing '\r'
+template <typename Visit>
+void forEachLine(const char* begin, const char* end, Visit visit) {
+    while (begin < end) {
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        const char* lineEnd = newline ? newline : end;
+        std::string_view line(begin, lineEnd - begin);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (!line.empty()) visit(line);
+        begin = lineEnd + 1;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || argc > 4) {
+        std::cerr << "Usage: " << argv[0] << " INPUT OUTPUT [BITS_PER_KEY]\n";
+        return 1;
+    }
+    const std::string inputPath = argv[1];
+    const std::string outputPath = argv[2];
+    double bitsPerKey = argc == 4 ? std::atof(argv[3]) : DEFAULT_BITS_PER_KEY;
+    if (!(bitsPerKey >= 1 && bitsPerKey <= 64)) {
+        std::cerr << "BITS_PER_KEY must be between 1 and 64\n";
+        return 1;
+    }
+
+    int input = open(inputPath.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info{};
+    if (input < 0 || fstat(input, &info) != 0 || info.st_size == 0) {
+        std::cerr << "Cannot read " << inputPath << "\n";
+        return 1;
+    }
+    size_t inputSize = info.st_size;
+    const char* data = static_cast<const char*>(mmap(nullptr, inputSize, PROT_READ, MAP_PRIVATE, input, 0));
+    close(input);
+    if (data == MAP_FAILED) {
+        std::cerr << "Cannot map " << inputPath << "\n";
+        return 1;
+    }
+    madvise(const_cast<char*>(data), inputSize, MADV_SEQUENTIAL);
+    auto started = std::chrono::steady_clock::now();
+
+    // First pass sizes the filter; duplicates in the corpus are counted but cost nothing extra
+    uint64_t keyCount = 0;
+    forEachLine(data, data + inputSize, [&](std::string_view) { ++keyCount; });
+    if (keyCount == 0) {
+        std::cerr << inputPath << " has no entries\n";
+        return 1;
+    }
+    uint64_t blockCount = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(keyCount * bitsPerKey / BLOCK_BITS)));
+    uint32_t hashesPerKey = std::clamp<uint32_t>(static_cast<uint32_t>(std::lround(bitsPerKey * std::log(2.0))),
+                                                 1, MAX_HASHES_PER_KEY);
+
+    // Bits are set directly in the mapped output file; it only replaces OUTPUT once complete
+    std::string temporaryPath = outputPath + ".tmp";
+    size_t outputSize = sizeof(Header) + blockCount * BLOCK_BYTES;
+    int output = open(temporaryPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (output < 0 || ftruncate(output, outputSize) != 0) {
+        std::cerr << "Cannot create " << temporaryPath << "\n";
+        return 1;
+    }
+    char* filter = static_cast<char*>(mmap(nullptr, outputSize, PROT_READ | PROT_WRITE, MAP_SHARED, output, 0));
+    if (filter == MAP_FAILED) {
+        std::cerr << "Cannot map " << temporaryPath << "\n";
+        return 1;
+    }
+    Header* header = reinterpret_cast<Header*>(filter);
+    std::memcpy(header->magic, FILTER_MAGIC, sizeof(header->magic));
+    header->blockCount = blockCount;
+    header->keyCount = keyCount;
+    header->hashesPerKey = hashesPerKey;
+    uint64_t* blocks = reinterpret_cast<uint64_t*>(filter + sizeof(Header));
+
+    // Line-aligned slices of the input, one per thread; bits are set with atomic ORs
+    unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<bool> hashFailed{false};
+    std::vector<std::thread> workers;
+    const char* sliceBegin = data;
+    for (unsigned int t = 0; t < threadCount; ++t) {
+        const char* sliceEnd = t + 1 == threadCount ? data + inputSize : data + inputSize * (t + 1) / threadCount;
+        if (sliceEnd < sliceBegin) sliceEnd = sliceBegin;
+        const char* newline = static_cast<const char*>(std::memchr(sliceEnd, '\n', data + inputSize - sliceEnd));
+        sliceEnd = newline ? newline + 1 : data + inputSize;
+        workers.emplace_back([&, sliceBegin, sliceEnd] {
+            unsigned char digest[20];
+            forEachLine(sliceBegin, sliceEnd, [&](std::string_view line) {
+                if (!lineDigest(line, digest)) {
+                    hashFailed = true;
+                    return;
+                }
+                Probe probe = probeFor(digest, blockCount, hashesPerKey);
+                uint64_t* block = blocks + probe.block * 8;
+                for (uint32_t i = 0; i < hashesPerKey; ++i) {
+                    __atomic_fetch_or(&block[probe.bits[i] / 64], uint64_t{1} << (probe.bits[i] % 64), __ATOMIC_RELAXED);
+                }
+            });
+        });
+        sliceBegin = sliceEnd;
+    }
+    for (auto& worker : workers) worker.join();
+    munmap(const_cast<char*>(data), inputSize);
+    if (hashFailed) {
+        std::cerr << "SHA-1 is unavailable\n";
+        unlink(temporaryPath.c_str());
+        return 1;
+    }
+
+    double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "Keys: " << keyCount << " (" << static_cast<long>(keyCount / buildSeconds) << " keys/s, "
+              << buildSeconds << " s)\n"
+              << "Filter: " << blockCount << " blocks, " << outputSize / (1024.0 * 1024.0) << " MiB, "
+              << bitsPerKey << " bits/key, " << hashesPerKey << " bits set per key\n";
+
+    // A probe is a false positive when all its bits are set, so the block fill predicts the rate
+    double predicted = 0;
+    uint64_t setBits = 0;
+    for (uint64_t b = 0; b < blockCount; ++b) {
+        uint32_t ones = 0;
+        for (int word = 0; word < 8; ++word) ones += __builtin_popcountll(blocks[b * 8 + word]);
+        setBits += ones;
+        predicted += std::pow(static_cast<double>(ones) / BLOCK_BITS, hashesPerKey);
+    }
+    predicted /= blockCount;
+
+    // Measured on strings that do not occur in any breach corpus, hashed like a real lookup
+    uint64_t falsePositives = 0;
+    unsigned char digest[20];
+    auto probing = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < FPR_PROBE_COUNT; ++i) {
+        std::string text = "\x01" "breach-filter-probe-" + std::to_string(i);
+        if (!sha1(text, digest)) break;
+        Probe probe = probeFor(digest, blockCount, hashesPerKey);
+        const uint64_t* block = blocks + probe.block * 8;
+        bool all = true;
+        for (uint32_t k = 0; k < hashesPerKey && all; ++k) {
+            all = block[probe.bits[k] / 64] & (uint64_t{1} << (probe.bits[k] % 64));
+        }
+        falsePositives += all;
+    }
+    double probeNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - probing).count() /
+                     FPR_PROBE_COUNT;
+    std::cout << "Fill: " << 100.0 * setBits / (blockCount * BLOCK_BITS) << "% of bits set\n"
+              << "False-positive rate: predicted " << predicted * 100 << "%, measured "
+              << 100.0 * falsePositives / FPR_PROBE_COUNT << "% (" << falsePositives << " of "
+              << FPR_PROBE_COUNT << " probes); " << probeNs << " ns per lookup including SHA-1\n";
+
+    if (msync(filter, outputSize, MS_SYNC) != 0 || fsync(output) != 0) {
+        std::cerr << "Cannot write " << temporaryPath << "\n";
+        return 1;
+    }
+    munmap(filter, outputSize);
+    close(output);
+    if (std::rename(temporaryPath.c_str(), outputPath.c_str()) != 0) {
+        std::cerr << "Cannot replace " << outputPath << "\n";
+        return 1;
+    }
+    std::cout << "Wrote " << outputPath << "\n";
+    return 0;
+}
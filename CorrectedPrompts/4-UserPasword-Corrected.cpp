@@ -1,8 +1,24 @@
 #include <iostream>
 #include <string>
-#include <regex>
 #include <vector>
 #include <limits>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
 
 // Security constants
 constexpr size_t MAX_INPUT_LENGTH = 256;
@@ -10,6 +26,14 @@ constexpr size_t MIN_PASSWORD_LENGTH = 12;
 const std::vector<std::string> COMMON_PASSWORDS = {
     "password", "123456", "qwerty", "letmein", "welcome"
 };
+// Breached substrings, one per line, added to COMMON_PASSWORDS when present
+const char* const COMMON_PASSWORDS_FILE = "common_passwords.txt";
+// Compiled automaton for the list, rebuilt whenever the list is newer and unused without it
+const char* const COMMON_PASSWORDS_IMAGE = "common_passwords.acimg";
+// Breach corpus filter from 4-BreachFilterBuilder; exact matches are rejected when present
+const char* const BREACH_FILTER_FILE = "breached_passwords.bloom";
+// Bytes of the audit file handed to a worker at a time; small enough to balance the tail
+constexpr size_t AUDIT_SLICE_BYTES = 256 * 1024;
 
 bool isInputValid(const std::string& input) {
     // Check length and basic character validity
@@ -18,22 +42,415 @@ bool isInputValid(const std::string& input) {
            input.find_first_of("\r\n\0") == std::string::npos;
 }
 
-bool isPasswordStrong(const std::string& password) {
+// Aho-Corasick automaton over the common-password substrings, stored as a double array:
+// the child of state s on byte b is t = base[s] + b + 1 when check[t] == s. Each state is one
+// 12-byte unit, so a step reads the current unit and the unit it moves to, whatever the list size.
+// Only "does any entry occur" is needed, so entries are not extended past a shorter entry that is
+// their prefix, and a state accepts when any suffix on its failure chain is an entry.
+class PasswordBlacklist {
+public:
+    // Builds from the entries; empty ones and ones longer than any valid input are dropped
+    explicit PasswordBlacklist(std::vector<std::string> entries) {
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [](const std::string& entry) {
+            return entry.empty() || entry.length() > MAX_INPUT_LENGTH;
+        }), entries.end());
+        std::sort(entries.begin(), entries.end());
+        entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+        // Unit 0 is the root and the free list's sentinel; unit 1 is never a child (base >= 1, label >= 1)
+        units.push_back(Unit{0, 0, 0});
+        nextFree.push_back(0);
+        previousFree.push_back(0);
+        grow(ALPHABET_SIZE + 2);
+        occupy(1);
+        std::vector<std::vector<Edge>> edgesByDepth(MAX_INPUT_LENGTH + 1);
+        if (!entries.empty()) placeChildren(entries, 0, 0, 0, entries.size(), edgesByDepth);
+        grow(units.size() + ALPHABET_SIZE + 1); // base + label never runs off the end
+        std::vector<uint32_t>().swap(nextFree);
+        std::vector<uint32_t>().swap(previousFree);
+        linkFailures(edgesByDepth);
+    }
+
+    // Reads an image written by save(); returns false if it is missing or not a valid image
+    static bool load(const std::string& path, std::unique_ptr<PasswordBlacklist>& blacklist) {
+        std::ifstream file(path, std::ios::binary);
+        ImageHeader header{};
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.unitCount < ALPHABET_SIZE + 2 || header.unitCount > std::numeric_limits<uint32_t>::max()) {
+            return false;
+        }
+        std::vector<Unit> units(header.unitCount);
+        if (!file.read(reinterpret_cast<char*>(units.data()), units.size() * sizeof(Unit))) return false;
+
+        // Every base must leave room for the largest label, so a corrupt image cannot read out of bounds
+        for (const Unit& unit : units) {
+            if (unit.base > units.size() - ALPHABET_SIZE - 1 || (unit.fail & ~ACCEPT) >= units.size()) return false;
+        }
+        // Every parent chain must reach the root, and every failure link must go to a shallower state,
+        // so the failure loop in occursIn always ends at the root
+        std::vector<uint32_t> depths;
+        if (!stateDepths(units, depths)) return false;
+        for (uint32_t state = 1; state < units.size(); ++state) {
+            uint32_t fail = units[state].fail & ~ACCEPT;
+            if (units[state].check != FREE && (depths[fail] == UNKNOWN_DEPTH || depths[fail] >= depths[state])) {
+                return false;
+            }
+        }
+        blacklist.reset(new PasswordBlacklist());
+        blacklist->units = std::move(units);
+        return true;
+    }
+
+    // Host byte order; the image is a cache next to the list, not an interchange format
+    bool save(const std::string& path) const {
+        std::string temporary = path + ".tmp";
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        ImageHeader header{};
+        std::memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+        header.unitCount = units.size();
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(units.data()), units.size() * sizeof(Unit));
+        file.close();
+        return file && std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+    // One left-to-right pass over the text
+    bool occursIn(std::string_view text) const {
+        uint32_t state = 0;
+        for (unsigned char byte : text) {
+            uint32_t label = byte + 1u;
+            while (true) {
+                uint32_t next = units[state].base + label;
+                if (units[next].check == state) {
+                    state = next;
+                    break;
+                }
+                if (state == 0) break;
+                state = units[state].fail & ~ACCEPT;
+            }
+            if (units[state].fail & ACCEPT) return true;
+        }
+        return false;
+    }
+
+    size_t stateCount() const { return units.size(); }
+
+private:
+    struct Unit {
+        uint32_t base;
+        uint32_t check;     // Parent state, or FREE
+        uint32_t fail;      // Failure state, with ACCEPT set on accepting states
+    };
+    struct Edge {
+        uint32_t parent;
+        uint32_t child;
+        uint32_t label;
+    };
+    struct ImageHeader {
+        char magic[8];
+        uint64_t unitCount;
+    };
+
+    static constexpr uint32_t ALPHABET_SIZE = 256;
+    static constexpr uint32_t FREE = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t ACCEPT = 1u << 31;
+    static constexpr uint32_t UNKNOWN_DEPTH = FREE;
+    static constexpr uint32_t PENDING_DEPTH = FREE - 1;
+    static constexpr char IMAGE_MAGIC[8] = {'P', 'W', 'A', 'C', 'D', 'A', '0', '1'};
+
+    std::vector<Unit> units;
+    // Unused units as a circular list through the sentinel 0, only while building
+    std::vector<uint32_t> nextFree;
+    std::vector<uint32_t> previousFree;
+
+    PasswordBlacklist() = default;
+
+    // Depth of each state along its parent chain, UNKNOWN_DEPTH for free units; false if a chain
+    // leaves the array, passes through a free unit or loops without reaching the root
+    static bool stateDepths(const std::vector<Unit>& units, std::vector<uint32_t>& depths) {
+        depths.assign(units.size(), UNKNOWN_DEPTH);
+        depths[0] = 0;
+        std::vector<uint32_t> chain;
+        for (uint32_t state = 1; state < units.size(); ++state) {
+            if (units[state].check == FREE || depths[state] != UNKNOWN_DEPTH) continue;
+            uint32_t ancestor = state;
+            while (depths[ancestor] == UNKNOWN_DEPTH) {
+                depths[ancestor] = PENDING_DEPTH;
+                chain.push_back(ancestor);
+                ancestor = units[ancestor].check;
+                if (ancestor >= units.size() || units[ancestor].check == FREE) return false;
+            }
+            if (depths[ancestor] == PENDING_DEPTH) return false;
+            for (uint32_t depth = depths[ancestor] + 1; !chain.empty(); chain.pop_back(), ++depth) {
+                depths[chain.back()] = depth;
+            }
+        }
+        return true;
+    }
+
+    // Appends free units up to size
+    void grow(size_t size) {
+        for (uint32_t unit = units.size(); unit < size; ++unit) {
+            units.push_back(Unit{0, FREE, 0});
+            nextFree.push_back(0);
+            previousFree.push_back(previousFree[0]);
+            nextFree[previousFree[0]] = unit;
+            previousFree[0] = unit;
+        }
+    }
+
+    void occupy(uint32_t unit) {
+        nextFree[previousFree[unit]] = nextFree[unit];
+        previousFree[nextFree[unit]] = previousFree[unit];
+    }
+
+    // Gives the node for entries[lo, hi) (which share their first depth bytes) a base where all its
+    // children fit, then does the same for each child
+    void placeChildren(const std::vector<std::string>& entries, uint32_t node, size_t depth, size_t lo, size_t hi,
+                       std::vector<std::vector<Edge>>& edgesByDepth) {
+        if (entries[lo].length() == depth) { // Sorted, so an entry ending here comes first
+            units[node].fail |= ACCEPT;
+            return;
+        }
+
+        std::vector<std::pair<uint32_t, size_t>> children; // Label and the first entry under it
+        for (size_t i = lo; i < hi; ++i) {
+            uint32_t label = static_cast<unsigned char>(entries[i][depth]) + 1u;
+            if (children.empty() || children.back().first != label) children.emplace_back(label, i);
+        }
+
+        // First free unit that can take the lowest label with every other label also landing on a free unit
+        uint32_t base = 0;
+        for (uint32_t position = nextFree[0]; ; position = nextFree[position]) {
+            if (position == 0) {
+                position = units.size();
+                grow(units.size() + ALPHABET_SIZE + 1);
+            }
+            if (position <= children.front().first) continue;
+            base = position - children.front().first;
+            grow(base + children.back().first + 1);
+            bool fits = true;
+            for (const auto& child : children) {
+                if (units[base + child.first].check != FREE) {
+                    fits = false;
+                    break;
+                }
+            }
+            if (fits) break;
+        }
+        units[node].base = base;
+        for (const auto& child : children) {
+            units[base + child.first].check = node;
+            occupy(base + child.first);
+            edgesByDepth[depth + 1].push_back(Edge{node, base + child.first, child.first});
+        }
+
+        for (size_t i = 0; i < children.size(); ++i) {
+            size_t end = i + 1 < children.size() ? children[i + 1].second : hi;
+            placeChildren(entries, base + children[i].first, depth + 1, children[i].second, end, edgesByDepth);
+        }
+    }
+
+    // Breadth-first, so every shallower state already has its failure link
+    void linkFailures(const std::vector<std::vector<Edge>>& edgesByDepth) {
+        for (size_t depth = 2; depth < edgesByDepth.size(); ++depth) {
+            for (const Edge& edge : edgesByDepth[depth]) {
+                uint32_t state = units[edge.parent].fail & ~ACCEPT;
+                uint32_t fail = 0;
+                while (true) {
+                    uint32_t next = units[state].base + edge.label;
+                    if (units[next].check == state) {
+                        fail = next;
+                        break;
+                    }
+                    if (state == 0) break;
+                    state = units[state].fail & ~ACCEPT;
+                }
+                units[edge.child].fail |= fail | (units[fail].fail & ACCEPT);
+            }
+        }
+    }
+};
+
+// The automaton for COMMON_PASSWORDS plus COMMON_PASSWORDS_FILE, built on first use. The image is
+// reused while it is newer than the list; otherwise the list is compiled and the image rewritten.
+// Without the list the image is ignored, so entries removed with the list do not stay in force.
+const PasswordBlacklist& commonPasswordBlacklist() {
+    static const std::unique_ptr<PasswordBlacklist> blacklist = [] {
+        std::unique_ptr<PasswordBlacklist> loaded;
+        struct stat list{}, image{};
+        bool haveList = stat(COMMON_PASSWORDS_FILE, &list) == 0;
+        bool imageCurrent = haveList && stat(COMMON_PASSWORDS_IMAGE, &image) == 0 &&
+                            image.st_mtime >= list.st_mtime;
+        if (imageCurrent && PasswordBlacklist::load(COMMON_PASSWORDS_IMAGE, loaded)) return loaded;
+
+        std::vector<std::string> entries(COMMON_PASSWORDS.begin(), COMMON_PASSWORDS.end());
+        if (haveList) {
+            std::ifstream file(COMMON_PASSWORDS_FILE);
+            std::string line;
+            while (std::getline(file, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                entries.push_back(line);
+            }
+        }
+        loaded.reset(new PasswordBlacklist(std::move(entries)));
+        if (haveList && !loaded->save(COMMON_PASSWORDS_IMAGE)) {
+            std::cerr << "Could not write " << COMMON_PASSWORDS_IMAGE << "\n";
+        }
+        return loaded;
+    }();
+    return *blacklist;
+}
+
+// Exact-match lookup against a breach corpus compiled by 4-BreachFilterBuilder: a blocked Bloom
+// filter over SHA-1(password), so HIBP-style hash lists can be loaded without the plaintexts.
+// The file is mapped read-only; a lookup is one SHA-1 and one 64-byte block.
+// The layout below must match 4-BreachFilterBuilder.cpp.
+class BreachFilter {
+public:
+    // nullptr with an empty error when the file does not exist; nullptr with error set when it is unusable
+    static std::unique_ptr<BreachFilter> open(const char* path, std::string& error) {
+        error.clear();
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno != ENOENT) error = std::string("cannot open ") + path + ": " + strerror(errno);
+            return nullptr;
+        }
+        struct stat info{};
+        fstat(fd, &info);
+        size_t size = info.st_size;
+        void* mapping = size >= sizeof(Header) ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            error = std::string(path) + " is not a breach filter";
+            return nullptr;
+        }
+
+        const Header* header = static_cast<const Header*>(mapping);
+        if (std::memcmp(header->magic, FILTER_MAGIC, sizeof(header->magic)) != 0 || header->blockCount == 0 ||
+            header->hashesPerKey == 0 || header->hashesPerKey > MAX_HASHES_PER_KEY ||
+            header->blockCount > (size - sizeof(Header)) / BLOCK_BYTES) {
+            munmap(mapping, size);
+            error = std::string(path) + " is not a breach filter";
+            return nullptr;
+        }
+        // Lookups land anywhere in the file; fault pages in as needed rather than read ahead
+        madvise(mapping, size, MADV_RANDOM);
+
+        std::unique_ptr<BreachFilter> filter(new BreachFilter());
+        filter->mapping = mapping;
+        filter->size = size;
+        filter->blocks = reinterpret_cast<const uint64_t*>(static_cast<const char*>(mapping) + sizeof(Header));
+        filter->blockCount = header->blockCount;
+        filter->hashesPerKey = header->hashesPerKey;
+        return filter;
+    }
+
+    ~BreachFilter() { munmap(mapping, size); }
+
+    BreachFilter(const BreachFilter&) = delete;
+    BreachFilter& operator=(const BreachFilter&) = delete;
+
+    // False positives at the rate the builder reported; never a false negative
+    bool contains(std::string_view password) const {
+        // One digest context per thread: fetching and allocating per call costs more than the hash
+        static EVP_MD* sha1 = EVP_MD_fetch(nullptr, "SHA1", nullptr);
+        thread_local std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> context(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+        unsigned char digest[20];
+        if (!sha1 || !context || EVP_DigestInit_ex2(context.get(), sha1, nullptr) != 1 ||
+            EVP_DigestUpdate(context.get(), password.data(), password.size()) != 1 ||
+            EVP_DigestFinal_ex(context.get(), digest, nullptr) != 1) {
+            return true; // Treat a hashing failure as breached rather than let the password through
+        }
+
+        // Digest bytes 0-7 pick the block; bytes 8-19 give up to ten 9-bit positions inside it
+        uint64_t selector, positions;
+        uint32_t morePositions;
+        std::memcpy(&selector, digest, sizeof(selector));
+        std::memcpy(&positions, digest + 8, sizeof(positions));
+        std::memcpy(&morePositions, digest + 16, sizeof(morePositions));
+        const uint64_t* block = blocks + static_cast<uint64_t>((static_cast<unsigned __int128>(selector) * blockCount) >> 64) * 8;
+        for (uint32_t i = 0; i < hashesPerKey; ++i) {
+            uint32_t bit = (i < 7 ? positions >> (9 * i) : morePositions >> (9 * (i - 7))) & 511;
+            if (!(block[bit / 64] & (uint64_t{1} << (bit % 64)))) return false;
+        }
+        return true;
+    }
+
+private:
+    struct Header {
+        char magic[8];
+        uint64_t blockCount;
+        uint64_t keyCount;
+        uint32_t hashesPerKey;
+        uint32_t reserved;
+        uint8_t padding[32];    // Blocks start on a cache line
+    };
+
+    static constexpr char FILTER_MAGIC[8] = {'P', 'W', 'B', 'L', 'O', 'O', 'M', '1'};
+    static constexpr size_t BLOCK_BYTES = 64;
+    static constexpr uint32_t MAX_HASHES_PER_KEY = 10;
+
+    void* mapping = nullptr;
+    size_t size = 0;
+    const uint64_t* blocks = nullptr;
+    uint64_t blockCount = 0;
+    uint32_t hashesPerKey = 0;
+
+    BreachFilter() = default;
+};
+
+// The filter in BREACH_FILTER_FILE, mapped on first use; nullptr when there is none.
+// A filter that exists but cannot be used stops the program instead of silently skipping the check.
+const BreachFilter* breachedPasswords() {
+    static const std::unique_ptr<BreachFilter> filter = [] {
+        std::string error;
+        std::unique_ptr<BreachFilter> opened = BreachFilter::open(BREACH_FILTER_FILE, error);
+        if (!error.empty()) {
+            std::cerr << "Breach filter error: " << error << "\n";
+            exit(1);
+        }
+        return opened;
+    }();
+    return filter.get();
+}
+
+// Rules a password can break; passwordViolations() reports them as a bit mask
+enum PasswordRule : unsigned {
+    RULE_TOO_SHORT = 1u << 0,
+    RULE_COMMON_PASSWORD = 1u << 1,
+    RULE_BREACHED = 1u << 2,
+    RULE_LOW_DIVERSITY = 1u << 3,
+};
+constexpr size_t PASSWORD_RULE_COUNT = 4;
+const char* const PASSWORD_RULE_NAMES[PASSWORD_RULE_COUNT] = {
+    "shorter than minimum length", "contains a common password", "in the breach corpus", "low character diversity"
+};
+
+// Every rule is evaluated, so audits can count each one
+unsigned passwordViolations(std::string_view password) {
+    unsigned violations = 0;
+
     // Check minimum length
     if (password.length() < MIN_PASSWORD_LENGTH) {
-        return false;
+        violations |= RULE_TOO_SHORT;
     }
 
     // Check for common passwords
-    for (const auto& common : COMMON_PASSWORDS) {
-        if (password.find(common) != std::string::npos) {
-            return false;
-        }
+    if (commonPasswordBlacklist().occursIn(password)) {
+        violations |= RULE_COMMON_PASSWORD;
+    }
+
+    // Check against the breach corpus
+    const BreachFilter* breached = breachedPasswords();
+    if (breached && breached->contains(password)) {
+        violations |= RULE_BREACHED;
     }
 
     // Check character diversity (at least 3 of: lowercase, uppercase, digit, special)
     bool hasLower = false, hasUpper = false, hasDigit = false, hasSpecial = false;
-    for (char c : password) {
+    for (unsigned char c : password) {
         if (islower(c)) hasLower = true;
         else if (isupper(c)) hasUpper = true;
         else if (isdigit(c)) hasDigit = true;
@@ -41,27 +458,20 @@ bool isPasswordStrong(const std::string& password) {
     }
     
     int diversity = hasLower + hasUpper + hasDigit + hasSpecial;
-    return diversity >= 3;
+    if (diversity < 3) {
+        violations |= RULE_LOW_DIVERSITY;
+    }
+    return violations;
 }
 
-bool isUsernameInPassword(const std::string& username, const std::string& password) {
-    try {
-        // Escape regex special characters in username
-        std::string escaped;
-        for (char c : username) {
-            if (strchr("\\.[]{}()*+?^$|", c)) {
-                escaped += '\\';
-            }
-            escaped += c;
-        }
+bool isPasswordStrong(std::string_view password) {
+    return passwordViolations(password) == 0;
+}
 
-        // Case-sensitive check (more secure than case-insensitive)
-        std::regex pattern(escaped);
-        return std::regex_search(password, pattern);
-    } catch (const std::regex_error&) {
-        // If regex fails, fall back to simple string search
-        return password.find(username) != std::string::npos;
-    }
+bool isUsernameInPassword(std::string_view username, std::string_view password) {
+    // Case-sensitive check (more secure than case-insensitive). A plain substring search: the
+    // username is matched literally, which is what the fully escaped regex used to do.
+    return password.find(username) != std::string_view::npos;
 }
 
 void secureInput(std::string& input, const char* prompt) {
@@ -85,9 +495,158 @@ void secureInput(std::string& input, const char* prompt) {
     }
 }
 
-int main() {
+// Counts for one audit worker, merged when all are done; padded so workers never share a line
+struct alignas(64) AuditTally {
+    uint64_t pairs = 0;
+    uint64_t malformed = 0;
+    uint64_t failing = 0;
+    uint64_t ruleViolations[PASSWORD_RULE_COUNT] = {};
+    uint64_t usernameInPassword = 0;
+};
+
+// A line-aligned byte range of the audit file
+struct AuditSlice {
+    size_t begin;
+    size_t end;
+};
+
+// One worker's share of the slices. The owner takes from the front; idle workers steal from the back.
+struct AuditQueue {
+    std::mutex mutex;
+    std::deque<AuditSlice> slices;
+};
+
+bool takeAuditSlice(std::vector<AuditQueue>& queues, size_t self, AuditSlice& slice) {
+    {
+        std::lock_guard<std::mutex> guard(queues[self].mutex);
+        if (!queues[self].slices.empty()) {
+            slice = queues[self].slices.front();
+            queues[self].slices.pop_front();
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        AuditQueue& victim = queues[(self + offset) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.mutex);
+        if (!victim.slices.empty()) {
+            slice = victim.slices.back();
+            victim.slices.pop_back();
+            return true;
+        }
+    }
+    return false; // All slices exist up front, so every queue empty means the audit is done
+}
+
+// Evaluate every "username<TAB>password" (or "username:password") line of a mapped file
+void auditSlice(std::string_view text, AuditTally& tally) {
+    while (!text.empty()) {
+        size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty()) continue;
+
+        ++tally.pairs;
+        size_t separator = line.find('\t');
+        if (separator == std::string_view::npos) separator = line.find(':');
+        std::string_view username = separator == std::string_view::npos ? std::string_view() : line.substr(0, separator);
+        std::string_view password = separator == std::string_view::npos ? std::string_view() : line.substr(separator + 1);
+        if (username.empty() || password.empty() || username.length() > MAX_INPUT_LENGTH ||
+            password.length() > MAX_INPUT_LENGTH) {
+            ++tally.malformed;
+            continue;
+        }
+
+        unsigned violations = passwordViolations(password);
+        for (size_t rule = 0; rule < PASSWORD_RULE_COUNT; ++rule) {
+            if (violations & (1u << rule)) ++tally.ruleViolations[rule];
+        }
+        bool containsUsername = isUsernameInPassword(username, password);
+        tally.usernameInPassword += containsUsername;
+        tally.failing += violations != 0 || containsUsername;
+    }
+}
+
+// Bulk policy audit of a credentials file on every core. The file is mapped and evaluated in
+// place; each worker starts with an equal share of slices and steals when its own run out.
+int auditPasswords(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat info{};
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        std::cerr << "Cannot read " << path << "\n";
+        return 1;
+    }
+    size_t size = info.st_size;
+    const char* data = size ? static_cast<const char*>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)) : nullptr;
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "Cannot map " << path << "\n";
+        return 1;
+    }
+
+    // Shared read-only state is built before any worker needs it
+    commonPasswordBlacklist();
+    breachedPasswords();
+
+    size_t workerCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<AuditQueue> queues(workerCount);
+    size_t sliceCount = 0;
+    for (size_t begin = 0; begin < size; ++sliceCount) {
+        size_t end = std::min(size, begin + AUDIT_SLICE_BYTES);
+        if (end < size) {
+            const char* newline = static_cast<const char*>(memchr(data + end, '\n', size - end));
+            end = newline ? newline - data + 1 : size;
+        }
+        queues[sliceCount % workerCount].slices.push_back(AuditSlice{begin, end});
+        begin = end;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    std::vector<AuditTally> tallies(workerCount);
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < workerCount; ++w) {
+        workers.emplace_back([&, w] {
+            AuditSlice slice;
+            while (takeAuditSlice(queues, w, slice)) {
+                auditSlice(std::string_view(data + slice.begin, slice.end - slice.begin), tallies[w]);
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    if (data) munmap(const_cast<char*>(data), size);
+
+    AuditTally total;
+    for (const AuditTally& tally : tallies) {
+        total.pairs += tally.pairs;
+        total.malformed += tally.malformed;
+        total.failing += tally.failing;
+        for (size_t rule = 0; rule < PASSWORD_RULE_COUNT; ++rule) total.ruleViolations[rule] += tally.ruleViolations[rule];
+        total.usernameInPassword += tally.usernameInPassword;
+    }
+
+    std::cout << "Audited " << total.pairs << " pairs in " << seconds << " s ("
+              << static_cast<long>(total.pairs / std::max(seconds, 1e-9)) << " pairs/s, "
+              << workerCount << " threads)\n"
+              << "Failing policy: " << total.failing << "\n";
+    for (size_t rule = 0; rule < PASSWORD_RULE_COUNT; ++rule) {
+        std::cout << "  " << PASSWORD_RULE_NAMES[rule] << ": " << total.ruleViolations[rule] << "\n";
+    }
+    std::cout << "  contains the username: " << total.usernameInPassword << "\n"
+              << "Malformed lines: " << total.malformed << "\n";
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // "--audit FILE" evaluates every username/password line of FILE and prints violation counts
+    if (argc == 3 && std::string(argv[1]) == "--audit") return auditPasswords(argv[2]);
+
     std::string username, password;
 
+    // Compile or load the blacklist and map the breach filter before prompting, not between the prompts and the verdict
+    commonPasswordBlacklist();
+    breachedPasswords();
+
     // Secure input handling
     secureInput(username, "Enter username: ");
     secureInput(password, "Enter password: ");